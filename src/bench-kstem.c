@@ -0,0 +1,467 @@
+/*
+   bench-kstem - measure the speed of stem().
+
+   The corpus is either the words of a file, or (by default) one generated
+   from the lexicon: every headword, and every headword with each of the
+   common inflectional and derivational endings added, so each of the
+   suffix routines gets exercised.  The generated corpus is also what
+   `make pgo' trains on.  With -T, it is a trace of real traffic recorded
+   by "kstem --capture" (see kstem-trace.h), replayed token for token, and
+   its make-up is reported first.
+
+   With -t, each pass has that many threads stem the whole corpus at once,
+   as the threads of an indexer would, and the rate is of all of them
+   together.  With KSTEM_CACHE set, the stem cache's counts are reported at
+   the end.
+
+   With -p, the processor's own counts (cycles, instructions, last-level
+   cache misses, branch misses and data TLB misses, from perf_event_open)
+   are reported for each phase as well: the load, the cold and warm passes,
+   and with -r, a pass over the words of the corpus with each ending, which
+   shows the suffix routines one at a time.  The counts are per word, with
+   the instructions per cycle, and are of user space alone (so
+   perf_event_paranoid may be as high as 2).  A count the machine can't
+   make (as in most virtual machines) is left out.
+
+   usage:  bench-kstem [-f corpus-file | -T trace] [-n passes] [-t threads] [-p] [-r]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "kstem.h"
+#include "kstem-counts.h"
+#include "kstem-trace.h"
+
+#define DEFAULT_PASSES 5
+#define MAX_THREADS 256
+
+
+/* endings added to each headword for the generated corpus */
+static const char *endings[] = {
+   "", "s", "es", "ies", "ed", "ied", "ing", "er", "ers", "or", "ly", "ally",
+   "al", "ical", "ive", "ative", "ize", "ization", "izer", "ment", "ity",
+   "ability", "ness", "ism", "ic", "ency", "ancy", "ence", "ance", "ation",
+   "ition", "ication", "ion", "able", "ible", NULL };
+
+
+typedef struct
+{
+   char *text;             /* the words, each followed by a '\0' */
+   size_t size, cap;
+   char **words;
+   unsigned int n;
+} CORPUS;
+
+
+static double now_ms()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static void add_text(CORPUS *c, const char *w, size_t len)
+{
+   if (c->size + len + 1 > c->cap)  {
+      c->cap = (c->size + len + 1) * 2;
+      c->text = (char *)realloc(c->text, c->cap);
+      }
+   memcpy(c->text + c->size, w, len);
+   c->size += len;
+   c->text[c->size++] = '\0';
+   c->n++;
+}
+
+/* the word pointers are set once all the text is in place, since the text
+   moves as it grows */
+static void index_words(CORPUS *c)
+{
+   size_t off = 0;
+   unsigned int i;
+
+   c->words = (char **)malloc(c->n * sizeof(char *));
+   for (i = 0; i < c->n; i++)  {
+      c->words[i] = c->text + off;
+      off += strlen(c->text + off) + 1;
+      }
+}
+
+
+static int read_corpus(CORPUS *c, const char *path)
+{
+   FILE *f = fopen(path, "r");
+   char word[4096];
+
+   if (!f)
+      return -1;
+   while (fscanf(f, "%4095s", word) == 1)
+      add_text(c, word, strlen(word));
+   fclose(f);
+   index_words(c);
+   return 0;
+}
+
+/* a trace: each token's text is in the corpus once, and the words point to
+   it as often as the token comes */
+
+#define LONG_TOKEN 20
+
+static int read_trace(CORPUS *c, const char *path)
+{
+   TRACE_READER *t = trace_open(path);
+   const char *token;
+   char **distinct;
+   unsigned int *ids = NULL, n = 0, cap = 0, id, i;
+   unsigned long not_letters = 0, capitalized = 0, long_tokens = 0;
+   size_t len, k;
+   int got;
+
+   if (!t)
+      return -1;
+   while ((got = trace_next(t, &id, &token, &len)) == 1)  {
+      if (id == c->n)
+         add_text(c, token, len);
+      if (n == cap)  {
+         cap = cap ? cap * 2 : 65536;
+         ids = (unsigned int *)realloc(ids, cap * sizeof(unsigned int));
+         }
+      ids[n++] = id;
+      for (k = 0; k < len && isalpha((unsigned char)token[k]); k++)
+         ;
+      not_letters += k < len;
+      capitalized += isupper((unsigned char)token[0]) != 0;
+      long_tokens += len > LONG_TOKEN;
+      }
+   if (got < 0)
+      fprintf(stderr, "bench-kstem: %s is cut short or corrupt; using the %u tokens before that\n", path, n);
+   if (n > 0)
+      printf("trace: %u tokens (%u distinct), sampled at %g%%; %.1f%% not all letters, %.1f%% capitalized, %.1f%% longer than %d bytes\n",
+             n, c->n, t->rate_ppm / 10000.0, 100.0 * not_letters / n, 100.0 * capitalized / n,
+             100.0 * long_tokens / n, LONG_TOKEN);
+   trace_free(t);
+
+   index_words(c);
+   distinct = c->words;
+   c->words = (char **)malloc((n ? n : 1) * sizeof(char *));
+   for (i = 0; i < n; i++)
+      c->words[i] = distinct[ids[i]];
+   c->n = n;
+   free(distinct);
+   free(ids);
+   return 0;
+}
+
+static int generate_corpus(CORPUS *c)
+{
+   char path[4096], word[4096], form[4200];
+   const char *stemdir = getenv("STEM_DIR");
+   FILE *f;
+   int i;
+
+   if (!stemdir)
+      return -1;
+   snprintf(path, sizeof(path), "%s/head_word_list.txt", stemdir);
+   f = fopen(path, "r");
+   if (!f)
+      return -1;
+   while (fscanf(f, "%4095s", word) == 1)
+      for (i = 0; endings[i] != NULL; i++)  {
+         snprintf(form, sizeof(form), "%s%s", word, endings[i]);
+         add_text(c, form, strlen(form));
+         }
+   fclose(f);
+   index_words(c);
+   return 0;
+}
+
+
+static CORPUS corpus;
+static size_t longest = 0;
+
+static void *stem_corpus(void *arg)
+{
+   char *thestem = (char *)malloc(longest + 256);
+   unsigned int i;
+
+   for (i = 0; i < corpus.n; i++)
+      stem(corpus.words[i], thestem);
+   free(thestem);
+   return NULL;
+}
+
+/* the processor's counts, for -p */
+
+enum { CYCLES, INSTRUCTIONS, LLC_MISSES, BRANCH_MISSES, DTLB_MISSES, NUM_COUNTERS };
+
+#define CACHE_EVENT(cache) \
+   ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct
+{
+   const char *name;
+   unsigned int type;
+   unsigned long long config;
+} counters[NUM_COUNTERS] = {
+   { "cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+   { "instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+   { "LLC misses",    PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_LL) },
+   { "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+   { "dTLB misses",   PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB) } };
+
+static int counter_fd[NUM_COUNTERS];
+static unsigned long long counter_start[NUM_COUNTERS][3];   /* the count, time enabled and time running */
+static int counting = 0;
+
+/* open the counters, for this thread and the threads it starts from now on
+   (their counts are added in as they finish) */
+
+static void open_counters()
+{
+   struct perf_event_attr attr;
+   int i;
+
+   for (i = 0; i < NUM_COUNTERS; i++)  {
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = counters[i].type;
+      attr.config = counters[i].config;
+      attr.disabled = 1;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      counter_fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+      if (counter_fd[i] < 0)
+         fprintf(stderr, "bench-kstem: %s can't be counted on this machine\n", counters[i].name);
+      else
+         counting++;
+      }
+}
+
+/* A phase is counted from the difference of two readings, since resetting
+   a counter doesn't reset what the threads that have finished added to it. */
+
+static void start_counters()
+{
+   int i;
+
+   for (i = 0; i < NUM_COUNTERS; i++)
+      if (counter_fd[i] >= 0)  {
+         if (read(counter_fd[i], counter_start[i], sizeof(counter_start[i])) != sizeof(counter_start[i]))
+            memset(counter_start[i], 0, sizeof(counter_start[i]));
+         ioctl(counter_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+         }
+}
+
+/* the counts since start_counters(), or -1 for those not made.  When there
+   are more counters than the processor has, the kernel takes turns with
+   them, and the counts are scaled up from the time each was counting. */
+
+static void stop_counters(double *counts)
+{
+   unsigned long long v[3];
+   int i;
+
+   for (i = 0; i < NUM_COUNTERS; i++)  {
+      counts[i] = -1;
+      if (counter_fd[i] < 0)
+         continue;
+      ioctl(counter_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+      if (read(counter_fd[i], v, sizeof(v)) == sizeof(v) && v[2] > counter_start[i][2])
+         counts[i] = (double)(v[0] - counter_start[i][0])
+                     * (v[1] - counter_start[i][1]) / (v[2] - counter_start[i][2]);
+      }
+}
+
+/* the counts per word (or all told, for words 0), after the line for the phase */
+
+static void report_counters(const double *counts, double words)
+{
+   const char *sep = "";
+   int i;
+
+   if (!counting)
+      return;
+   printf("       ");
+   if (counts[CYCLES] > 0 && counts[INSTRUCTIONS] >= 0)
+      printf(" IPC %.2f;", counts[INSTRUCTIONS] / counts[CYCLES]);
+   printf(words > 0 ? " per word:" : " in all:");
+   for (i = 0; i < NUM_COUNTERS; i++)
+      if (counts[i] >= 0)  {
+         printf(words > 0 ? "%s %.2f %s" : "%s %.0f %s", sep, words > 0 ? counts[i] / words : counts[i],
+                counters[i].name);
+         sep = ",";
+         }
+   printf("\n");
+}
+
+
+/* -r: the words of the corpus grouped by the longest of endings[] they
+   end in (the first group, for "", has the words that end in none of
+   them), each group stemmed on its own */
+
+static void bench_endings()
+{
+   unsigned int nendings, *group, *start, *members, e, i, len, best;
+   double t, ms, counts[NUM_COUNTERS];
+   char *thestem = (char *)malloc(longest + 256);
+   size_t n;
+
+   for (nendings = 0; endings[nendings] != NULL; nendings++)
+      ;
+   group = (unsigned int *)malloc(corpus.n * sizeof(unsigned int));
+   start = (unsigned int *)calloc(nendings + 1, sizeof(unsigned int));
+   members = (unsigned int *)malloc(corpus.n * sizeof(unsigned int));
+   for (i = 0; i < corpus.n; i++)  {
+      len = strlen(corpus.words[i]);
+      best = 0;
+      for (e = 1; e < nendings; e++)  {
+         n = strlen(endings[e]);
+         if (n < len && n > strlen(endings[best]) && strcmp(corpus.words[i] + len - n, endings[e]) == 0)
+            best = e;
+         }
+      group[i] = best;
+      start[best + 1]++;
+      }
+   for (e = 0; e < nendings; e++)
+      start[e + 1] += start[e];
+   for (i = 0; i < corpus.n; i++)
+      members[start[group[i]]++] = i;
+   for (e = nendings; e > 0; e--)
+      start[e] = start[e - 1];
+   start[0] = 0;
+
+   for (e = 0; e < nendings; e++)  {
+      if (start[e + 1] == start[e])
+         continue;
+      if (counting)
+         start_counters();
+      t = now_ms();
+      for (i = start[e]; i < start[e + 1]; i++)
+         stem(corpus.words[members[i]], thestem);
+      ms = now_ms() - t;
+      if (counting)
+         stop_counters(counts);
+      printf("-%-9s %8u words %8.1f ns/word\n", e == 0 ? "(other)" : endings[e],
+             start[e + 1] - start[e], ms * 1e6 / (start[e + 1] - start[e]));
+      if (counting)
+         report_counters(counts, start[e + 1] - start[e]);
+      }
+   free(group);
+   free(start);
+   free(members);
+   free(thestem);
+}
+
+
+static void report_cache()
+{
+   KSTEM_CACHE_STATS s;
+   double lookups;
+
+   kstem_cache_stats(&s);
+   if (s.entries == 0)
+      return;
+   lookups = s.hits + s.misses > 0 ? (double)(s.hits + s.misses) : 1.0;
+   printf("cache: %lu entries, %.1f%% hits (%lu), %lu misses (%lu found in the snapshot), %lu evictions\n",
+          s.entries, 100.0 * s.hits / lookups, s.hits, s.misses, s.snapshot_hits, s.evictions);
+   printf("contention: %lu raced reads, %lu stems not kept (shard locked)\n", s.raced_reads, s.locked_out);
+}
+
+
+int main(int argc, char *argv[])
+{
+   pthread_t threads[MAX_THREADS];
+   const char *file = NULL, *trace = NULL;
+   double t, ms, counts[NUM_COUNTERS];
+   unsigned int i, pass, passes = DEFAULT_PASSES;
+   int c, nthreads = 1, perf = 0, by_ending = 0;
+
+   while ((c = getopt(argc, argv, "f:T:n:t:pr")) != -1)  {
+      switch (c)  {
+         case 'f':
+            file = optarg;
+            break;
+         case 'T':
+            trace = optarg;
+            break;
+         case 'n':
+            passes = atoi(optarg);
+            break;
+         case 't':
+            nthreads = atoi(optarg);
+            if (nthreads < 1 || nthreads > MAX_THREADS)  {
+               fprintf(stderr, "bench-kstem: the number of threads must be between 1 and %d\n", MAX_THREADS);
+               exit(1);
+               }
+            break;
+         case 'p':
+            perf = 1;
+            break;
+         case 'r':
+            by_ending = 1;
+            break;
+         default:
+            fprintf(stderr, "usage: bench-kstem [-f corpus-file | -T trace] [-n passes] [-t threads] [-p] [-r]\n");
+            exit(1);
+         }
+      }
+
+   if (perf)
+      open_counters();
+   if (counting)
+      start_counters();
+   t = now_ms();
+   read_dict_info();
+   printf("load:  %10.3f ms\n", now_ms() - t);
+   if (counting)  {
+      stop_counters(counts);
+      report_counters(counts, 0);
+      }
+
+   memset(&corpus, 0, sizeof(corpus));
+   if ((trace ? read_trace(&corpus, trace) : file ? read_corpus(&corpus, file) : generate_corpus(&corpus)) != 0
+       || corpus.n == 0)  {
+      fprintf(stderr, "bench-kstem: couldn't read the corpus\n");
+      exit(1);
+      }
+   for (i = 0; i < corpus.n; i++)
+      if (strlen(corpus.words[i]) > longest)
+         longest = strlen(corpus.words[i]);
+   printf("corpus: %u words\n", corpus.n);
+
+   /* the first pass runs with cold caches; the rest show the steady state */
+   for (pass = 0; pass < passes; pass++)  {
+      if (counting)
+         start_counters();
+      t = now_ms();
+      if (nthreads == 1)
+         stem_corpus(NULL);
+      else  {
+         for (c = 0; c < nthreads; c++)
+            pthread_create(&threads[c], NULL, stem_corpus, NULL);
+         for (c = 0; c < nthreads; c++)
+            pthread_join(threads[c], NULL);
+         }
+      ms = now_ms() - t;
+      if (counting)
+         stop_counters(counts);
+      printf("%s %u: %10.3f ms %8.1f ns/word %8.2f Mwords/s\n", pass == 0 ? "cold" : "warm",
+             pass + 1, ms, ms * 1e6 / ((double)corpus.n * nthreads), (double)corpus.n * nthreads / ms / 1000.0);
+      if (counting)
+         report_counters(counts, (double)corpus.n * nthreads);
+      }
+   if (by_ending)
+      bench_endings();
+   report_cache();
+   return 0;
+}
@@ -0,0 +1,142 @@
+/*
+   bench-lexicon - measure dictionary lookup latency as the lexicon grows.
+
+   Synthetic lexicons of 10 thousand up to (by default) 10 million words are
+   built in the dictionary table (lexicon.c), and random words are then looked
+   up, half of them present and half absent.  For the smaller sizes, the old
+   chained hash table (hash.c, with the 40000 buckets it was always created
+   with) is measured too, for comparison.
+
+   usage:  bench-lexicon [max-words]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "hash.h"
+#include "lexicon.h"
+
+#define LOOKUPS 1000000          /* lookups timed for each size */
+#define HASH_MAX_WORDS 1000000   /* the chained table is too slow to go further */
+
+
+static unsigned long long rng = 88172645463325252ULL;
+
+static unsigned int next_random()
+{
+   rng ^= rng << 13;
+   rng ^= rng >> 7;
+   rng ^= rng << 17;
+   return (unsigned int)rng;
+}
+
+static double now_ms()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+
+/* words of 4 to 15 lower-case letters, packed one after another */
+
+static char *make_words(unsigned int n, char **words)
+{
+   char *text, *p;
+   unsigned int i, len, c;
+
+   text = (char *)malloc((size_t)n * 16);
+   p = text;
+   for (i = 0; i < n; i++)  {
+      words[i] = p;
+      len = 4 + next_random() % 12;
+      for (c = 0; c < len; c++)
+         *p++ = 'a' + next_random() % 26;
+      *p++ = '\0';
+      }
+   return text;
+}
+
+
+/* the word to look up next: one of the lexicon words, or a word that
+   differs from it in its last letter by a character no word contains */
+
+static char *probe(char **words, unsigned int n, char *miss, int hit)
+{
+   char *w = words[next_random() % n];
+   size_t len;
+
+   if (hit)
+      return w;
+   len = strlen(w);
+   memcpy(miss, w, len + 1);
+   miss[len - 1] = '#';
+   return miss;
+}
+
+
+static void bench(unsigned int n)
+{
+   char **words;
+   char *text, miss[32];
+   LEXICON *lex;
+   HASH *h;
+   double t, build, lookup_hit, lookup_miss;
+   unsigned int i, found = 0;
+
+   words = (char **)malloc(n * sizeof(char *));
+   text = make_words(n, words);
+
+   t = now_ms();
+   lex = lex_create(0, 0);              /* let the table grow on its own */
+   for (i = 0; i < n; i++)
+      lex_add(lex, words[i], "", 0);
+   build = now_ms() - t;
+
+   t = now_ms();
+   for (i = 0; i < LOOKUPS; i++)
+      found += lex_find(lex, probe(words, n, miss, 1)) != NULL;
+   lookup_hit = (now_ms() - t) * 1e6 / LOOKUPS;
+   t = now_ms();
+   for (i = 0; i < LOOKUPS; i++)
+      found += lex_find(lex, probe(words, n, miss, 0)) != NULL;
+   lookup_miss = (now_ms() - t) * 1e6 / LOOKUPS;
+
+   printf("%10u %10u %12.1f %12.1f %12.1f %10.1f", n, lex->nentries, build,
+          lookup_hit, lookup_miss,
+          (lex->nslots * sizeof(LEXSLOT) + lex->pool_cap) / (1024.0 * 1024.0));
+   lex_free(lex);
+
+   if (n <= HASH_MAX_WORDS)  {
+      h = create_hash(40000);
+      for (i = 0; i < n; i++)
+         insert_hash(h, words[i], words[i]);
+      t = now_ms();
+      for (i = 0; i < LOOKUPS / 10; i++)
+         found += search_hash(h, probe(words, n, miss, 1)) != NULL;
+      printf(" %12.1f", (now_ms() - t) * 1e6 / (LOOKUPS / 10));
+      }
+   printf("\n");
+   fflush(stdout);
+
+   free(text);
+   free(words);
+}
+
+
+int main(int argc, char *argv[])
+{
+   unsigned int max = 10000000, n;
+
+   if (argc > 1)
+      max = atoi(argv[1]);
+
+   printf("%10s %10s %12s %12s %12s %10s %12s\n", "words", "entries", "build ms",
+          "hit ns", "miss ns", "MB", "hash.c ns");
+   for (n = 10000; n < max; n *= 10)
+      bench(n);
+   bench(max);
+   return 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * hot-words.h - the table of hot words: the most frequent word forms, with
+ *               their stems worked out in advance (see public-kstem-v0.8.c).
+ *
+ * The table is generated when the stemmer is built, by make-hot-words, from
+ * the frequency list hot-words.txt and the lexicon in STEM_DIR, and written
+ * to hot-words-table.h.  Each entry is a word and its stem, each of up to
+ * HOT_LENGTH - 1 letters, 16 bytes in all, so four share a cache line and the
+ * whole table is HOT_SLOTS / 4 lines.  A word is found by hashing its
+ * letters, read as one 64-bit integer, and probing at most HOT_PROBES
+ * entries from there; make-hot-words chooses the multiplier of the hash
+ * (HOT_MULTIPLIER) that keeps HOT_PROBES smallest.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define HOT_BITS 8
+#define HOT_SLOTS (1 << HOT_BITS)
+#define HOT_WORDS 128            /* at most this many of the list are used */
+#define HOT_LENGTH 8             /* room for a word or stem and its '\0' */
+
+typedef struct
+{
+   char word[HOT_LENGTH];        /* padded with '\0' */
+   char stem[HOT_LENGTH];
+} HOTWORD;
+
+/* the letters of a word of len < HOT_LENGTH, as an integer */
+static inline uint64_t hot_key(const char *w, size_t len)
+{
+   uint64_t key = 0;
+
+   memcpy(&key, w, len);
+   return key;
+}
+
+static inline unsigned int hot_hash(uint64_t key, uint64_t multiplier)
+{
+   return (unsigned int)((key * multiplier) >> (64 - HOT_BITS));
+}
@@ -0,0 +1,105 @@
+/*
+ * kstem-analyzer.h - a C++ analyzer over the streams of kstem.h, for
+ *                    programs that push text through the stemmer as it
+ *                    arrives (network reads, file blocks) without staging it.
+ *
+ *    kstem::Analyzer a;
+ *    while ((n = read(fd, buf, sizeof(buf))) > 0)
+ *       a.feed(buf, n, [&](const KSTEM_SPAN &t) { index(t.start, t.stem); });
+ *    a.finish([&](const KSTEM_SPAN &t) { index(t.start, t.stem); });
+ *
+ * or, pulling the tokens of each piece:
+ *
+ *    for (const KSTEM_SPAN &t : a.tokens(buf, n))
+ *       ...
+ *    for (const KSTEM_SPAN &t : a.end())
+ *       ...
+ *
+ * A token split between pieces comes out whole, with the piece that
+ * completes it, and offsets count from the start of the stream.  The text
+ * and stem of a token are valid until the next one is produced.  After the
+ * end of a stream the analyzer is ready for the next, and it keeps its
+ * buffers, so an analyzer per thread, reused, allocates nothing once it has
+ * seen its longest token.
+ */
+
+#ifndef KSTEM_ANALYZER_H
+#define KSTEM_ANALYZER_H
+
+#include "kstem.h"
+
+namespace kstem {
+
+class Analyzer
+{
+public:
+   Analyzer() : stream(kstem_stream_new()) {}
+   ~Analyzer() { kstem_stream_free(stream); }
+   Analyzer(const Analyzer &) = delete;
+   Analyzer &operator=(const Analyzer &) = delete;
+
+   /* call fn(span) for each token the piece data[0..len) completes; returns
+      how many there were */
+   template <typename F> size_t feed(const char *data, size_t len, F fn)
+   {
+      KSTEM_SPAN span;
+      size_t n = 0;
+
+      kstem_stream_write(stream, data, len);
+      while (kstem_stream_next(stream, &span))  {
+         fn(static_cast<const KSTEM_SPAN &>(span));
+         n++;
+         }
+      return n;
+   }
+
+   /* the end of the stream: fn gets the last token, if it was unfinished */
+   template <typename F> size_t finish(F fn) { return feed(NULL, 0, fn); }
+
+
+   /* the tokens of a piece, as an input range */
+
+   class iterator
+   {
+   public:
+      iterator(KSTEM_STREAM *s = NULL) : stream(s) { ++*this; }
+      const KSTEM_SPAN &operator*() const { return span; }
+      const KSTEM_SPAN *operator->() const { return &span; }
+      iterator &operator++()
+      {
+         if (stream && !kstem_stream_next(stream, &span))
+            stream = NULL;
+         return *this;
+      }
+      bool operator==(const iterator &other) const { return stream == other.stream; }
+      bool operator!=(const iterator &other) const { return stream != other.stream; }
+   private:
+      KSTEM_STREAM *stream;     /* NULL once the piece is used up */
+      KSTEM_SPAN span;
+   };
+
+   class range
+   {
+   public:
+      range(KSTEM_STREAM *s) : stream(s) {}
+      iterator begin() const { return iterator(stream); }
+      iterator end() const { return iterator(); }
+   private:
+      KSTEM_STREAM *stream;
+   };
+
+   /* the range must be used up before the next piece is given */
+   range tokens(const char *data, size_t len)
+   {
+      kstem_stream_write(stream, data, len);
+      return range(stream);
+   }
+   range end() { return tokens(NULL, 0); }
+
+private:
+   KSTEM_STREAM *stream;
+};
+
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+   kstem-check - check the lexicon files in STEM_DIR, and write the
+                 dictionary image the stemmer maps at load time.
+
+   Every problem with the files is reported (loading stops at the first):
+   a missing file, a word listed twice, an 'e' ending exception that isn't
+   in the dictionary, and a variant without a root at the end of a
+   two-column file.  If there are none, the dictionary built from the files
+   is written as an image, kstem.image in STEM_DIR unless -o names another
+   file (or -n is given, to check only).
+
+   usage:  kstem-check [-n] [-o image]
+
+   read_dict_info() maps the image rather than reading the files, as long
+   as the files' contents haven't changed since (a copy of the directory
+   will do), so loading costs next to nothing; it checks only that the
+   image holds together, not the words in it.  Run
+   kstem-check again whenever the lexicon files are edited; until then the
+   image is ignored, and the files are read as usual.
+
+   The exit status is 1 if there were problems.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "kstem.h"
+
+
+int main (int argc, char *argv[]) {
+
+   const char *stemdir = getenv("STEM_DIR");
+   char *image = NULL;
+   int c, check_only = 0, problems;
+
+   while ((c = getopt(argc, argv, "no:")) != -1)
+      switch (c)  {
+         case 'n':
+            check_only = 1;
+            break;
+         case 'o':
+            image = optarg;
+            break;
+         default:
+            fprintf(stderr, "usage: kstem-check [-n] [-o image]\n");
+            exit(1);
+         }
+
+   if (!check_only && image == NULL && stemdir != NULL)  {
+      image = (char *)malloc(strlen(stemdir) + sizeof("/kstem.image"));
+      sprintf(image, "%s/kstem.image", stemdir);
+      }
+
+   problems = kstem_check_lexicon(check_only ? NULL : image);
+   if (problems > 0)  {
+      fprintf(stderr, "kstem-check: %d problem%s with the lexicon files in %s\n",
+              problems, problems == 1 ? "" : "s", stemdir ? stemdir : "(no STEM_DIR)");
+      exit(1);
+      }
+   if (!check_only)
+      printf("kstem-check: the lexicon files are good; wrote %s\n", image);
+   else
+      printf("kstem-check: the lexicon files are good\n");
+   return 0;
+}
@@ -0,0 +1,487 @@
+/*
+ * Counting stems in process (see kstem-counts.h).
+ *
+ * Each thread takes the next block of the input (cut after a separator, so
+ * no word is split), stems its words with kstem_spans() -- the same
+ * tokenizer and stemmer as the normal output -- and counts them in a tally
+ * of its own.  The tallies are merged once the input is exhausted.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "kstem.h"
+#include "kstem-counts.h"
+
+#define BLOCK_SIZE (1024*1024)   /* input taken by a thread at a time */
+#define MAX_THREADS 256
+#define SKETCH_FACTOR 8          /* counters kept per word asked for with --top */
+#define MIN_SKETCH 1024
+
+
+static unsigned int hash_word(const char *w, size_t len)
+{
+  unsigned int h = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    h = (h ^ (unsigned char)w[i]) * 16777619u;
+  return h;
+}
+
+
+void tally_init(TALLY *t, unsigned int limit)
+{
+  memset(t, 0, sizeof(TALLY));
+  t->limit = limit;
+  t->cap = limit ? limit : 1024;
+  t->entries = (TALLYENTRY *)malloc(t->cap * sizeof(TALLYENTRY));
+  t->nindex = 2048;
+  while (t->nindex < t->cap * 2)
+    t->nindex *= 2;
+  t->index = (unsigned int *)calloc(t->nindex, sizeof(unsigned int));
+  if (limit)
+    t->heap = (unsigned int *)malloc(limit * sizeof(unsigned int));
+}
+
+void tally_free(TALLY *t)
+{
+  unsigned int i;
+
+  for (i = 0; i < t->n; i++)
+    free(t->entries[i].word);
+  free(t->entries);
+  free(t->index);
+  free(t->heap);
+}
+
+
+/* the index slot holding word, or the empty slot where it would go */
+
+static unsigned int find_slot(const TALLY *t, const char *w, size_t len, unsigned int h)
+{
+  unsigned int mask = t->nindex - 1;
+  unsigned int i = h & mask;
+  const TALLYENTRY *e;
+
+  while (t->index[i] != 0)
+    {
+      e = &t->entries[t->index[i] - 1];
+      if (e->hash == h && strncmp(e->word, w, len) == 0 && e->word[len] == '\0')
+	break;
+      i = (i + 1) & mask;
+    }
+  return i;
+}
+
+static void grow_index(TALLY *t)
+{
+  unsigned int i, j, mask;
+
+  free(t->index);
+  t->nindex *= 2;
+  mask = t->nindex - 1;
+  t->index = (unsigned int *)calloc(t->nindex, sizeof(unsigned int));
+  for (i = 0; i < t->n; i++)
+    {
+      for (j = t->entries[i].hash & mask; t->index[j] != 0; j = (j + 1) & mask)
+	;
+      t->index[j] = i + 1;
+    }
+}
+
+/* take entry e out of the index, moving later entries of its run back so
+   that every entry can still be reached */
+
+static void unindex(TALLY *t, unsigned int e)
+{
+  unsigned int mask = t->nindex - 1;
+  unsigned int i, j, home;
+
+  for (i = t->entries[e].hash & mask; t->index[i] != e + 1; i = (i + 1) & mask)
+    ;
+  t->index[i] = 0;
+  for (j = (i + 1) & mask; t->index[j] != 0; j = (j + 1) & mask)
+    {
+      home = t->entries[t->index[j] - 1].hash & mask;
+      /* the entry at j can move to i if i lies between its home and j */
+      if (((j - home) & mask) >= ((j - i) & mask))
+	{
+	  t->index[i] = t->index[j];
+	  t->index[j] = 0;
+	  i = j;
+	}
+    }
+}
+
+
+/* restore the heap below position p after a count there grew */
+
+static void sift_down(TALLY *t, unsigned int p)
+{
+  unsigned int c, e = t->heap[p];
+
+  for (;;)
+    {
+      c = 2 * p + 1;
+      if (c >= t->n)
+	break;
+      if (c + 1 < t->n && t->entries[t->heap[c+1]].count < t->entries[t->heap[c]].count)
+	c++;
+      if (t->entries[t->heap[c]].count >= t->entries[e].count)
+	break;
+      t->heap[p] = t->heap[c];
+      t->entries[t->heap[p]].heap = p;
+      p = c;
+    }
+  t->heap[p] = e;
+  t->entries[e].heap = p;
+}
+
+static void sift_up(TALLY *t, unsigned int p)
+{
+  unsigned int e = t->heap[p];
+
+  while (p > 0 && t->entries[t->heap[(p-1)/2]].count > t->entries[e].count)
+    {
+      t->heap[p] = t->heap[(p-1)/2];
+      t->entries[t->heap[p]].heap = p;
+      p = (p - 1) / 2;
+    }
+  t->heap[p] = e;
+  t->entries[e].heap = p;
+}
+
+
+static char *copy_word(const char *w, size_t len)
+{
+  char *s = (char *)malloc(len + 1);
+
+  memcpy(s, w, len);
+  s[len] = '\0';
+  return s;
+}
+
+
+/* count word count more times.  In a limited tally that is full, a word
+   not already there replaces the word with the smallest count.  Returns the
+   number of the word's entry (which, in an unlimited tally, is the number of
+   words that were there before it first came). */
+
+unsigned int tally_add(TALLY *t, const char *w, size_t len, unsigned long count, unsigned long error)
+{
+  unsigned int h = hash_word(w, len);
+  unsigned int i = find_slot(t, w, len, h);
+  unsigned int n;
+  TALLYENTRY *e;
+  unsigned long least;
+
+  if (t->index[i] != 0)
+    {
+      n = t->index[i] - 1;
+      e = &t->entries[n];
+      e->count += count;
+      e->error += error;
+      if (t->limit)
+	sift_down(t, e->heap);
+      return n;
+    }
+
+  if (t->limit && t->n == t->limit)
+    {
+      n = t->heap[0];
+      e = &t->entries[n];
+      least = e->count;
+      unindex(t, t->heap[0]);
+      free(e->word);
+      e->word = copy_word(w, len);
+      e->hash = h;
+      e->count = least + count;
+      e->error = least + error;
+      i = find_slot(t, w, len, h);
+      t->index[i] = n + 1;
+      sift_down(t, 0);
+      return n;
+    }
+
+  if (t->n == t->cap)
+    {
+      t->cap *= 2;
+      t->entries = (TALLYENTRY *)realloc(t->entries, t->cap * sizeof(TALLYENTRY));
+    }
+  e = &t->entries[t->n];
+  e->word = copy_word(w, len);
+  e->hash = h;
+  e->count = count;
+  e->error = error;
+  t->index[i] = ++t->n;
+  if (t->limit)
+    {
+      t->heap[t->n - 1] = t->n - 1;
+      sift_up(t, t->n - 1);
+    }
+  if (t->n * 2 > t->nindex)
+    grow_index(t);
+  return t->n - 1;
+}
+
+
+/* the entry for word, or NULL */
+
+static TALLYENTRY *tally_find(const TALLY *t, const char *w)
+{
+  size_t len = strlen(w);
+  unsigned int i = find_slot(t, w, len, hash_word(w, len));
+
+  return t->index[i] ? &t->entries[t->index[i] - 1] : NULL;
+}
+
+/* what a word missing from a full limited tally may have been counted: at
+   most the smallest count */
+
+static unsigned long floor_count(const TALLY *t)
+{
+  return t->limit && t->n == t->limit ? t->entries[t->heap[0]].count : 0;
+}
+
+
+/* add the counts of one tally to another.  Limited tallies are merged as
+   mergeable summaries: each word's count is the sum of its counts in both,
+   where a word missing from a full tally is given that tally's smallest
+   count, and the largest of the sums are kept. */
+
+void tally_merge(TALLY *into, const TALLY *from)
+{
+  TALLY both;
+  TALLYENTRY **sorted;
+  unsigned long floor_into, floor_from;
+  unsigned int i, limit = into->limit;
+
+  if (!limit)
+    {
+      for (i = 0; i < from->n; i++)
+	tally_add(into, from->entries[i].word, strlen(from->entries[i].word),
+		  from->entries[i].count, from->entries[i].error);
+      return;
+    }
+
+  floor_into = floor_count(into);
+  floor_from = floor_count(from);
+  tally_init(&both, 0);
+  for (i = 0; i < into->n; i++)
+    {
+      TALLYENTRY *e = &into->entries[i];
+      unsigned long missing = tally_find(from, e->word) ? 0 : floor_from;
+      tally_add(&both, e->word, strlen(e->word), e->count + missing, e->error + missing);
+    }
+  for (i = 0; i < from->n; i++)
+    {
+      const TALLYENTRY *e = &from->entries[i];
+      unsigned long missing = tally_find(into, e->word) ? 0 : floor_into;
+      tally_add(&both, e->word, strlen(e->word), e->count + missing, e->error + missing);
+    }
+
+  sorted = tally_sorted(&both, 1);
+  tally_free(into);
+  tally_init(into, limit);
+  for (i = 0; i < both.n && i < limit; i++)
+    tally_add(into, sorted[i]->word, strlen(sorted[i]->word), sorted[i]->count, sorted[i]->error);
+  free(sorted);
+  tally_free(&both);
+}
+
+
+static int by_count(const void *a, const void *b)
+{
+  const TALLYENTRY *x = *(const TALLYENTRY **)a, *y = *(const TALLYENTRY **)b;
+
+  if (x->count != y->count)
+    return x->count > y->count ? -1 : 1;
+  return strcmp(x->word, y->word);
+}
+
+static int by_word(const void *a, const void *b)
+{
+  return strcmp((*(const TALLYENTRY **)a)->word, (*(const TALLYENTRY **)b)->word);
+}
+
+/* the guaranteed counts (see run_counts()), highest first, ties in byte order */
+
+static int by_least_count(const void *a, const void *b)
+{
+  const TALLYENTRY *x = *(const TALLYENTRY **)a, *y = *(const TALLYENTRY **)b;
+
+  if (x->count - x->error != y->count - y->error)
+    return x->count - x->error > y->count - y->error ? -1 : 1;
+  return strcmp(x->word, y->word);
+}
+
+/* the entries, most frequent first (ties in byte order), or in byte order */
+
+TALLYENTRY **tally_sorted(const TALLY *t, int count_order)
+{
+  TALLYENTRY **sorted = (TALLYENTRY **)malloc((t->n + 1) * sizeof(TALLYENTRY *));
+  unsigned int i;
+
+  for (i = 0; i < t->n; i++)
+    sorted[i] = &t->entries[i];
+  qsort(sorted, t->n, sizeof(TALLYENTRY *), count_order ? by_count : by_word);
+  return sorted;
+}
+
+
+
+/* the threads of run_counts() */
+
+typedef struct
+{
+  TALLY tally;
+  LEXICON *overlay;
+  unsigned int profile;
+} COUNTER;
+
+static FILE *input;
+static pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *carry = NULL;           /* the end of the last block, after its last separator */
+static size_t carry_len = 0, carry_cap = 0;
+static int input_done = 0;
+
+
+static int is_separator(char c)
+{
+  return isspace((unsigned char)c) != 0;
+}
+
+/* take the next block of the input into *buf.  The block ends just after a
+   separator (or at the end of the input), so no word is cut in two. */
+
+static size_t next_block(char **buf, size_t *cap)
+{
+  size_t len, got, cut;
+
+  pthread_mutex_lock(&input_lock);
+  len = 0;
+  if (carry_len > 0)
+    {
+      if (carry_len > *cap)
+	{
+	  *cap = carry_len * 2;
+	  *buf = (char *)realloc(*buf, *cap);
+	}
+      memcpy(*buf, carry, carry_len);
+      len = carry_len;
+      carry_len = 0;
+    }
+  while (!input_done)
+    {
+      if (len + BLOCK_SIZE > *cap)
+	{
+	  *cap = len + BLOCK_SIZE;
+	  *buf = (char *)realloc(*buf, *cap);
+	}
+      got = fread(*buf + len, 1, BLOCK_SIZE, input);
+      len += got;
+      if (got < BLOCK_SIZE)
+	{
+	  input_done = 1;
+	  break;
+	}
+      for (cut = len; cut > 0 && !is_separator((*buf)[cut - 1]); cut--)
+	;
+      if (cut > 0)
+	{
+	  carry_len = len - cut;
+	  if (carry_len > carry_cap)
+	    {
+	      carry_cap = carry_len * 2;
+	      carry = (char *)realloc(carry, carry_cap);
+	    }
+	  memcpy(carry, *buf + cut, carry_len);
+	  len = cut;
+	  break;
+	}
+      /* one word longer than a block: keep reading until it ends */
+    }
+  pthread_mutex_unlock(&input_lock);
+  return len;
+}
+
+static void count_span(const KSTEM_SPAN *span, void *arg)
+{
+  tally_add((TALLY *)arg, span->stem, span->stem_length, 1, 0);
+}
+
+static void *counter(void *arg)
+{
+  COUNTER *me = (COUNTER *)arg;
+  char *buf = NULL;
+  size_t cap = 0, len;
+
+  kstem_set_overlay(me->overlay);
+  kstem_set_profile(me->profile);
+  while ((len = next_block(&buf, &cap)) > 0)
+    kstem_spans(buf, len, count_span, &me->tally);
+  free(buf);
+  return NULL;
+}
+
+
+/* stem every word of in and write each stem with its count to out, in the
+   format of uniq -c.  With top, only the top most frequent stems are kept
+   (and written), using a limited tally in each thread.  Their counts are
+   then upper bounds, so what is written is the count less its error: the
+   number of times the stem is certain to have occurred, never more than
+   the true count. */
+
+int run_counts(FILE *in, FILE *out, int nthreads, int count_order, unsigned int top, LEXICON *overlay,
+	       unsigned int profile)
+{
+  pthread_t threads[MAX_THREADS];
+  COUNTER *counters;
+  TALLYENTRY **sorted;
+  unsigned int i, n, limit = 0;
+
+  if (nthreads < 1)
+    nthreads = 1;
+  if (nthreads > MAX_THREADS)
+    nthreads = MAX_THREADS;
+  if (top)
+    limit = top * SKETCH_FACTOR > MIN_SKETCH ? top * SKETCH_FACTOR : MIN_SKETCH;
+
+  input = in;
+  counters = (COUNTER *)calloc(nthreads, sizeof(COUNTER));
+  for (i = 0; i < (unsigned int)nthreads; i++)
+    {
+      tally_init(&counters[i].tally, limit);
+      counters[i].overlay = overlay;
+      counters[i].profile = profile;
+      pthread_create(&threads[i], NULL, counter, &counters[i]);
+    }
+  for (i = 0; i < (unsigned int)nthreads; i++)
+    pthread_join(threads[i], NULL);
+  for (i = 1; i < (unsigned int)nthreads; i++)
+    {
+      tally_merge(&counters[0].tally, &counters[i].tally);
+      tally_free(&counters[i].tally);
+    }
+
+  /* the top words are chosen by count, whatever order they are written in */
+  n = counters[0].tally.n;
+  sorted = tally_sorted(&counters[0].tally, 1);
+  if (top && top < n)
+    n = top;
+  if (!count_order)
+    qsort(sorted, n, sizeof(TALLYENTRY *), by_word);
+  else if (top)
+    qsort(sorted, n, sizeof(TALLYENTRY *), by_least_count);
+  for (i = 0; i < n; i++)
+    fprintf(out, "%7lu %s\n", sorted[i]->count - (top ? sorted[i]->error : 0), sorted[i]->word);
+
+  free(sorted);
+  tally_free(&counters[0].tally);
+  free(counters);
+  return ferror(in) ? 1 : 0;
+}
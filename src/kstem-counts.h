@@ -0,0 +1,40 @@
+/*
+ * Counting stems in process, for "kstem --counts" (instead of piping the
+ * stems through sort | uniq -c).
+ *
+ * A TALLY counts words.  Without a limit it is exact, and grows as needed.
+ * With a limit it is a Space-Saving sketch of that many counters: when a new
+ * word arrives and every counter is taken, the word with the smallest count
+ * is replaced, and the new word inherits that count (as its error).  The
+ * counts are then upper bounds, and any word that occurs more than N/limit
+ * times in N words is certain to be kept.
+ */
+
+typedef struct
+{
+  char *word;
+  unsigned long count;
+  unsigned long error;         /* how much of count may belong to words it replaced */
+  unsigned int hash;
+  unsigned int heap;           /* position in the heap (limited tallies only) */
+} TALLYENTRY;
+
+typedef struct
+{
+  TALLYENTRY *entries;
+  unsigned int n, cap;
+  unsigned int *index;         /* open addressing: entry number + 1, or 0 if empty */
+  unsigned int nindex;         /* always a power of two */
+  unsigned int limit;          /* the number of counters, or 0 for an exact count */
+  unsigned int *heap;          /* entry numbers, the smallest count first */
+} TALLY;
+
+
+void tally_init(TALLY *t, unsigned int limit);
+void tally_free(TALLY *t);
+unsigned int tally_add(TALLY *t, const char *word, size_t len, unsigned long count, unsigned long error);
+void tally_merge(TALLY *into, const TALLY *from);
+TALLYENTRY **tally_sorted(const TALLY *t, int by_count);
+
+int run_counts(FILE *in, FILE *out, int nthreads, int by_count, unsigned int top, LEXICON *overlay,
+	       unsigned int profile);
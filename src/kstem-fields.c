@@ -0,0 +1,323 @@
+/*
+ * Stemming selected fields of records (see kstem-fields.h).
+ *
+ * TSV:   --tsv=2,5 stems the words of the second and fifth columns.
+ * JSON:  --json=title,body stems the words of the strings that are the
+ *        values of members named title or body, at any depth (including
+ *        the strings inside an array or object that is such a value).
+ *
+ * The words of a field are found and stemmed by kstem_spans(), as in the
+ * normal output, and the text between them is kept as it is.  Inside a JSON
+ * string the escapes \n, \t and \r also separate words; any other escape is
+ * part of the word it is in, and a word with an escape in it is not
+ * alphabetic, so the stemmer only lowercases it (the result is still valid
+ * JSON).  A line that isn't valid JSON is passed through unchanged.
+ *
+ * Each record is built in an output buffer that is reused, so once the
+ * buffers have grown to the longest record nothing is allocated.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kstem.h"
+#include "kstem-fields.h"
+
+#define MAX_DEPTH 256             /* nesting allowed in a JSON record */
+
+
+typedef struct
+{
+  char *buf;
+  size_t len, cap;
+} OUTPUT;
+
+/* the words being stemmed into an OUTPUT */
+typedef struct
+{
+  OUTPUT *out;
+  const char *text;
+  size_t pos;                  /* text up to here has been written */
+} FIELD;
+
+
+static void put(OUTPUT *o, const char *s, size_t n)
+{
+  if (o->len + n > o->cap)
+    {
+      o->cap = (o->len + n) * 2;
+      o->buf = (char *)realloc(o->buf, o->cap);
+    }
+  memcpy(o->buf + o->len, s, n);
+  o->len += n;
+}
+
+static void put_stem(const KSTEM_SPAN *span, void *arg)
+{
+  FIELD *f = (FIELD *)arg;
+
+  put(f->out, f->text + f->pos, span->start - f->pos);
+  put(f->out, span->stem, span->stem_length);
+  f->pos = span->start + span->length;
+}
+
+/* write text[0..len) with its words stemmed */
+
+static void stem_text(OUTPUT *o, const char *text, size_t len)
+{
+  FIELD f;
+
+  f.out = o;
+  f.text = text;
+  f.pos = 0;
+  kstem_spans(text, len, put_stem, &f);
+  put(o, text + f.pos, len - f.pos);
+}
+
+
+/* the selected names or column numbers, as a list of '\0'-terminated names */
+
+static char **names;
+static unsigned int nnames;
+static unsigned char *columns;   /* columns[i] is set if column i is selected */
+static unsigned int ncolumns;
+
+static int parse_fields(int format, const char *fields)
+{
+  char *copy = strdup(fields), *name;
+  unsigned int c;
+
+  names = (char **)malloc((strlen(fields) + 1) * sizeof(char *));
+  for (name = strtok(copy, ","); name != NULL; name = strtok(NULL, ","))
+    names[nnames++] = name;
+  if (nnames == 0)
+    return -1;
+  if (format == FIELDS_TSV)
+    {
+      for (c = 0; c < nnames; c++)
+	if (atoi(names[c]) < 1)
+	  return -1;
+	else if ((unsigned int)atoi(names[c]) > ncolumns)
+	  ncolumns = atoi(names[c]);
+      columns = (unsigned char *)calloc(ncolumns + 1, 1);
+      for (c = 0; c < nnames; c++)
+	columns[atoi(names[c])] = 1;
+    }
+  return 0;
+}
+
+
+/* TSV: the selected columns of the line are stemmed */
+
+static void stem_tsv(OUTPUT *o, const char *line, size_t len)
+{
+  const char *p = line, *end = line + len, *tab;
+  unsigned int column = 1;
+
+  while (p <= end)
+    {
+      tab = (const char *)memchr(p, '\t', end - p);
+      if (tab == NULL)
+	tab = end;
+      if (column <= ncolumns && columns[column])
+	stem_text(o, p, tab - p);
+      else
+	put(o, p, tab - p);
+      if (tab < end)
+	put(o, "\t", 1);
+      p = tab + 1;
+      column++;
+    }
+}
+
+
+/* JSON: a recursive scan of one value.  Each routine returns the position
+   just after what it scanned, or NULL if the text is not valid JSON. */
+
+typedef struct
+{
+  OUTPUT *out;
+  const char *end;
+  const char *written;         /* the line up to here is in out */
+} SCAN;
+
+static const char *skip_space(const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+    p++;
+  return p;
+}
+
+/* the end of the string that starts (with its quote) at p */
+
+static const char *string_end(const char *p, const char *end)
+{
+  for (p++; p < end; p++)
+    if (*p == '\\')
+      p++;
+    else if (*p == '"')
+      return p + 1;
+  return NULL;
+}
+
+static int selected_name(const char *key, size_t len)
+{
+  unsigned int i;
+
+  for (i = 0; i < nnames; i++)
+    if (strncmp(names[i], key, len) == 0 && names[i][len] == '\0')
+      return 1;
+  return 0;
+}
+
+/* write the contents of a string (between its quotes) with its words
+   stemmed, treating the escapes \n, \t and \r as separators */
+
+static void stem_string(SCAN *s, const char *p, const char *q)
+{
+  const char *seg = p;
+
+  put(s->out, s->written, p - s->written);
+  while (p < q)
+    {
+      if (*p == '\\' && p + 1 < q)
+	{
+	  if (p[1] == 'n' || p[1] == 't' || p[1] == 'r')
+	    {
+	      stem_text(s->out, seg, p - seg);
+	      put(s->out, p, 2);
+	      seg = p + 2;
+	    }
+	  p += 2;
+	}
+      else
+	p++;
+    }
+  stem_text(s->out, seg, q - seg);
+  s->written = q;
+}
+
+static const char *scan_value(SCAN *s, const char *p, int selected, int depth);
+
+static const char *scan_members(SCAN *s, const char *p, int selected, int depth, int object)
+{
+  const char *key, *q;
+  char close = object ? '}' : ']';
+  int sel = selected;
+
+  p = skip_space(p + 1, s->end);
+  if (p < s->end && *p == close)
+    return p + 1;
+  for (;;)
+    {
+      if (object)
+	{
+	  p = skip_space(p, s->end);
+	  if (p >= s->end || *p != '"' || (q = string_end(p, s->end)) == NULL)
+	    return NULL;
+	  key = p + 1;
+	  sel = selected || selected_name(key, q - 1 - key);
+	  p = skip_space(q, s->end);
+	  if (p >= s->end || *p != ':')
+	    return NULL;
+	  p++;
+	}
+      if ((p = scan_value(s, p, sel, depth + 1)) == NULL)
+	return NULL;
+      p = skip_space(p, s->end);
+      if (p < s->end && *p == ',')
+	p++;
+      else if (p < s->end && *p == close)
+	return p + 1;
+      else
+	return NULL;
+    }
+}
+
+static const char *scan_value(SCAN *s, const char *p, int selected, int depth)
+{
+  const char *q;
+
+  if (depth > MAX_DEPTH)
+    return NULL;
+  p = skip_space(p, s->end);
+  if (p >= s->end)
+    return NULL;
+  switch (*p)
+    {
+    case '{':
+    case '[':
+      return scan_members(s, p, selected, depth, *p == '{');
+    case '"':
+      if ((q = string_end(p, s->end)) == NULL)
+	return NULL;
+      if (selected)
+	stem_string(s, p + 1, q - 1);
+      return q;
+    default:
+      /* a number, true, false or null */
+      for (q = p; q < s->end && strchr(",]} \t\r\n", *q) == NULL; q++)
+	;
+      return q > p ? q : NULL;
+    }
+}
+
+static int stem_json(OUTPUT *o, const char *line, size_t len)
+{
+  SCAN s;
+  const char *p;
+  size_t start = o->len;
+
+  s.out = o;
+  s.end = line + len;
+  s.written = line;
+  p = scan_value(&s, line, 0, 0);
+  if (p == NULL || skip_space(p, s.end) != s.end)
+    {
+      o->len = start;
+      put(o, line, len);
+      return -1;
+    }
+  put(o, s.written, s.end - s.written);
+  return 0;
+}
+
+
+/* stem the selected fields of every record of in */
+
+int run_fields(FILE *in, FILE *out, int format, const char *fields)
+{
+  OUTPUT o = { NULL, 0, 0 };
+  char *line = NULL;
+  size_t cap = 0, len;
+  ssize_t n;
+  unsigned long lineno = 0, bad = 0;
+
+  if (parse_fields(format, fields) != 0)
+    {
+      fprintf(stderr, "kstem: no fields to stem in \"%s\"\n", fields);
+      return 1;
+    }
+  while ((n = getline(&line, &cap, in)) >= 0)
+    {
+      lineno++;
+      len = n;
+      if (len > 0 && line[len - 1] == '\n')
+	len--;
+      o.len = 0;
+      if (format == FIELDS_TSV)
+	stem_tsv(&o, line, len);
+      else if (skip_space(line, line + len) == line + len)
+	put(&o, line, len);           /* a blank line */
+      else if (stem_json(&o, line, len) != 0 && bad++ == 0)
+	fprintf(stderr, "kstem: line %lu is not valid JSON; passing it through unchanged\n", lineno);
+      put(&o, line + len, n - len);
+      fwrite(o.buf, 1, o.len, out);
+    }
+  if (bad > 1)
+    fprintf(stderr, "kstem: %lu lines were not valid JSON\n", bad);
+  free(line);
+  free(o.buf);
+  return 0;
+}
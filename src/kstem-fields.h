@@ -0,0 +1,10 @@
+/*
+ * Stemming selected fields of TSV or JSON Lines records, for
+ * "kstem --tsv" and "kstem --json".  Everything but the words of the
+ * selected fields is passed through byte for byte.
+ */
+
+#define FIELDS_TSV  1
+#define FIELDS_JSON 2
+
+int run_fields(FILE *in, FILE *out, int format, const char *fields);
@@ -1,29 +1,859 @@
+/*
+   kstem-file - stem all the words in files, one stem per line.
+
+   usage:  kstem-file [-j threads] [-o output-dir] [-f list-file] [-z gzip|zstd]
+                      [--io=uring|read] [--profile=profile] file-or-directory ...
+
+   The files are given as arguments (a directory stands for every file under
+   it) or listed one per line in list-file (-f, or --files-from; "-" reads
+   the list from the standard input).  The dictionary is loaded once, and the
+   files are stemmed by a pool of threads (-j, one per processor by default).
+
+   With -o (--output-dir), the stems of each file are written to a file of
+   the same name under output-dir, so the output is a tree parallel to the
+   input (a leading "/" is dropped from the name).  Otherwise they are
+   written to the standard output, each file's stems together, and -- if
+   there is more than one file -- preceded by a line "==> name <==".  The
+   stems are written as they are made, a WRITE_SIZE piece at a time; with
+   more than one file, the first to have stems to write has the output to
+   itself until it is finished, while the others being stemmed meanwhile
+   hold theirs in temporary files, and are copied out after it, in the
+   order they finish.
+
+   Input: each thread keeps many reads in flight with io_uring (falling back
+   to pread() where io_uring isn't available, or with --io=read), and stems
+   each block as soon as it arrives.  The output files of -o are written the
+   same way.
+
+   Compression: a file compressed with gzip (or zstd, when built with
+   HAVE_ZSTD) is recognized by its first bytes and decompressed on a thread
+   of its own, a block at a time, as it is stemmed.  With -z (--compress),
+   the output is compressed too; under -o each output file is named for its
+   input without the ".gz" or ".zst", and with the new suffix added.
+
+   Profiles: with --profile, the stems are made with the given profile (see
+   kstem_parse_profile()), e.g. --profile=inflectional to remove only the
+   inflectional endings.
+
+   Scheduling: the files are dealt out, largest first, to a queue for each
+   thread.  A thread takes the largest file left in its own queue, and when
+   that is empty, steals the smallest file left in another's, so a few large
+   files don't leave the other threads idle.
+*/
+
 #include <stdlib.h>
 #include <stdio.h>
-void stem(char *term, char *stem);
-void read_dict_info() ;
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "kstem.h"
+#include "kstem-io.h"
+#include "kstem-zio.h"
+
+#define MAX_THREADS 256
+#define READ_SIZE (256*1024)       /* read from a file at a time */
+#define WRITE_SIZE (256*1024)      /* stems collected before they are written */
+#define QUEUE_DEPTH 16             /* reads in flight for each thread */
+#define MAX_OPEN 8                 /* files a thread has open at a time */
+
+
+typedef struct
+{
+   char *path;
+   off_t size;
+} JOB;
+
+/* the files of one thread, jobs[head..tail) in decreasing size */
+typedef struct
+{
+   pthread_mutex_t lock;
+   unsigned int *jobs;
+   unsigned int head, tail;
+} QUEUE;
+
+typedef struct
+{
+   char *buf;
+   size_t len, cap;
+} OUTPUT;
+
+
+static JOB *jobs = NULL;
+static unsigned int njobs = 0, jobs_cap = 0;
+
+static QUEUE queues[MAX_THREADS];
+static int nthreads;
+
+static const char *output_dir = NULL;
+static int headers = 0;
+static int compress = ZIO_NONE;            /* the output's compression */
+static unsigned int profile = KSTEM_FULL;
+static FILE *out;                          /* the output, without -o */
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+static int output_owner = -1;              /* the job writing to out, with headers */
+static FILE **spilled = NULL;              /* finished jobs' stems, waiting for out */
+static unsigned int nspilled = 0, spilled_cap = 0;
+static int failed = 0;
+
+
+/* ---------------------------- finding the files ---------------------------- */
+
+static void add_job(const char *path, off_t size)
+{
+   if (njobs == jobs_cap)  {
+      jobs_cap = jobs_cap ? jobs_cap * 2 : 1024;
+      jobs = (JOB *)realloc(jobs, jobs_cap * sizeof(JOB));
+      }
+   jobs[njobs].path = strdup(path);
+   jobs[njobs].size = size;
+   njobs++;
+}
+
+/* a file, or every file under a directory */
+
+static void add_path(const char *path)
+{
+   struct stat st;
+   struct dirent *e;
+   DIR *d;
+   char *sub;
+
+   if (stat(path, &st) != 0)  {
+      fprintf(stderr, "kstem-file: couldn't open the input file: %s\n", path);
+      failed = 1;
+      return;
+      }
+   if (!S_ISDIR(st.st_mode))  {
+      add_job(path, st.st_size);
+      return;
+      }
+   d = opendir(path);
+   if (!d)  {
+      fprintf(stderr, "kstem-file: couldn't read the directory: %s\n", path);
+      failed = 1;
+      return;
+      }
+   while ((e = readdir(d)) != NULL)  {
+      if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+         continue;
+      sub = (char *)malloc(strlen(path) + strlen(e->d_name) + 2);
+      sprintf(sub, "%s%s%s", path, path[strlen(path) - 1] == '/' ? "" : "/", e->d_name);
+      add_path(sub);
+      free(sub);
+      }
+   closedir(d);
+}
+
+static void add_files_from(const char *list)
+{
+   FILE *f = strcmp(list, "-") == 0 ? stdin : fopen(list, "r");
+   char *line = NULL;
+   size_t cap = 0;
+   ssize_t n;
+
+   if (!f)  {
+      fprintf(stderr, "kstem-file: couldn't open the list of files: %s\n", list);
+      exit(1);
+      }
+   while ((n = getline(&line, &cap, f)) >= 0)  {
+      while (n > 0 && (line[n-1] == '\n' || line[n-1] == '\r'))
+         line[--n] = '\0';
+      if (n > 0)
+         add_path(line);
+      }
+   free(line);
+   if (f != stdin)
+      fclose(f);
+}
+
+
+/* ------------------------------- scheduling -------------------------------- */
+
+static int larger_first(const void *a, const void *b)
+{
+   const JOB *x = (const JOB *)a, *y = (const JOB *)b;
+
+   return x->size > y->size ? -1 : x->size < y->size ? 1 : 0;
+}
+
+static void deal_jobs()
+{
+   unsigned int i;
+   int t;
+
+   qsort(jobs, njobs, sizeof(JOB), larger_first);
+   for (t = 0; t < nthreads; t++)  {
+      pthread_mutex_init(&queues[t].lock, NULL);
+      queues[t].jobs = (unsigned int *)malloc((njobs / nthreads + 1) * sizeof(unsigned int));
+      queues[t].head = queues[t].tail = 0;
+      }
+   for (i = 0; i < njobs; i++)  {
+      t = i % nthreads;
+      queues[t].jobs[queues[t].tail++] = i;
+      }
+}
+
+/* the next file for thread me: its own largest, or another's smallest.
+   Returns -1 when there are none left anywhere. */
+
+static int next_job(int me)
+{
+   QUEUE *q;
+   int j = -1, i;
+
+   q = &queues[me];
+   pthread_mutex_lock(&q->lock);
+   if (q->head < q->tail)
+      j = q->jobs[q->head++];
+   pthread_mutex_unlock(&q->lock);
+
+   for (i = 1; j < 0 && i < nthreads; i++)  {
+      q = &queues[(me + i) % nthreads];
+      pthread_mutex_lock(&q->lock);
+      if (q->head < q->tail)
+         j = q->jobs[--q->tail];
+      pthread_mutex_unlock(&q->lock);
+      }
+   return j;
+}
+
+
+/* -------------------------------- stemming --------------------------------- */
+
+static void put(OUTPUT *o, const char *s, size_t n)
+{
+   if (o->len + n > o->cap)  {
+      o->cap = (o->len + n) * 2;
+      o->buf = (char *)realloc(o->buf, o->cap);
+      }
+   memcpy(o->buf + o->len, s, n);
+   o->len += n;
+}
+
+static void put_stem(const KSTEM_SPAN *span, void *arg)
+{
+   OUTPUT *o = (OUTPUT *)arg;
+
+   put(o, span->stem, span->stem_length);
+   put(o, "\n", 1);
+}
+
+/* create the directories leading to path */
+
+static int make_parents(char *path)
+{
+   char *p;
+
+   for (p = strchr(path + 1, '/'); p != NULL; p = strchr(p + 1, '/'))  {
+      *p = '\0';
+      if (mkdir(path, 0777) != 0 && errno != EEXIST)  {
+         *p = '/';
+         return -1;
+         }
+      *p = '/';
+      }
+   return 0;
+}
+
+/* where the stems of path go under output_dir, or NULL if it would be
+   outside it.  The suffix of a compressed input (".gz") is dropped, and
+   that of the output's compression added. */
+
+static char *output_path(const char *path, int format)
+{
+   const char *in_suffix = zio_suffix(format), *out_suffix = zio_suffix(compress);
+   size_t len;
+   char *name;
+
+   while (*path == '/')
+      path++;
+   if (strcmp(path, "..") == 0 || strncmp(path, "../", 3) == 0 || strstr(path, "/../") != NULL
+       || (strlen(path) >= 3 && strcmp(path + strlen(path) - 3, "/..") == 0))
+      return NULL;
+   len = strlen(path);
+   if (len > strlen(in_suffix) && strcmp(path + len - strlen(in_suffix), in_suffix) == 0)
+      len -= strlen(in_suffix);
+   name = (char *)malloc(strlen(output_dir) + len + strlen(out_suffix) + 2);
+   sprintf(name, "%s/%.*s%s", output_dir, (int)len, path, out_suffix);
+   return name;
+}
+
+
+/* Each thread keeps up to QUEUE_DEPTH reads in flight, through an IOQUEUE
+   (io_uring where possible), running ahead into the next few files in its
+   queue, and stems each block as it arrives, in order.  The stems of a file
+   written under -o are written the same way, a block at a time, while the
+   next blocks are stemmed.  A block is stemmed up to its last separator;
+   the word cut at its end is carried into the next block. */
+
+typedef struct
+{
+   int job;
+   int in, out;
+   off_t size;
+   off_t next;                 /* where the next read starts */
+   unsigned int blocks;        /* reads issued */
+   unsigned int done;          /* blocks stemmed */
+   int all_read;               /* the last read has been issued */
+   int finished;               /* the last block has been stemmed */
+   int error;
+   unsigned int writes;        /* writes in flight */
+   off_t written;              /* where the next write starts */
+   OUTPUT carry;               /* the word cut at the end of the last block */
+   OUTPUT stems;               /* stems not yet written */
+   FILE *spill;                /* the stems while another job has out */
+   char *out_name;
+   ZWRITER *zw;                /* compressing the stems, with -z */
+} FILEWORK;
+
+typedef struct
+{
+   int file;                   /* its FILEWORK */
+   char *buf;
+   off_t offset;
+   unsigned int want;
+   int result;                 /* bytes read, -errno, or PENDING */
+} BLOCK;
+
+typedef struct
+{
+   int file;
+   char *buf;
+   unsigned int len;
+   off_t offset;
+} WRITE;
+
+#define PENDING (-1000000)
+#define READ_TAG(b) (((unsigned long)(b) << 1) | 1)    /* writes are tagged with their WRITE */
+
+typedef struct
+{
+   IOQUEUE q;
+   FILEWORK files[MAX_OPEN];
+   int in_use[MAX_OPEN];
+   int reading;                /* the file being read ahead, or -1 */
+   BLOCK blocks[QUEUE_DEPTH];
+   unsigned int head, count;   /* the blocks in flight, oldest first */
+   int me;
+   int no_more_jobs;
+} WORKER;
+
+static int io_backend = IOQ_URING;
+
+
+static void handle_completion(WORKER *w, IOCOMPLETION *c);
+static void stem_compressed(WORKER *w, FILEWORK *f, int format);
+
+/* wait for (and handle) one completion */
+
+static void collect(WORKER *w)
+{
+   IOCOMPLETION c;
+
+   if (ioq_wait(&w->q, &c) == 0)
+      handle_completion(w, &c);
+}
+
+static void release_file(WORKER *w, FILEWORK *f)
+{
+   if (f->out >= 0)
+      close(f->out);
+   free(f->out_name);
+   free(f->carry.buf);
+   free(f->stems.buf);
+   if (f->zw)
+      zw_close(f->zw);
+   w->in_use[f - w->files] = 0;
+}
+
+/* send the stems collected so far to the output file (compressed, with
+   -z; finish ends the compressed stream) */
+
+static void write_stems(WORKER *w, FILEWORK *f, int finish)
+{
+   WRITE *wr;
+   char *buf;
+   size_t len;
+
+   if (f->zw)  {
+      if (f->stems.len == 0 && !finish)
+         return;
+      len = zw_compress(f->zw, f->stems.buf, f->stems.len, finish, &buf);
+      f->stems.len = 0;
+      if (len == 0)  {
+         free(buf);
+         return;
+         }
+      }
+   else  {
+      if (f->stems.len == 0)
+         return;
+      buf = f->stems.buf;
+      len = f->stems.len;
+      f->stems.buf = NULL;
+      f->stems.len = f->stems.cap = 0;
+      }
+   while (ioq_full(&w->q))
+      collect(w);
+   wr = (WRITE *)malloc(sizeof(WRITE));
+   wr->file = f - w->files;
+   wr->buf = buf;
+   wr->len = len;
+   wr->offset = f->written;
+   f->written += wr->len;
+   f->writes++;
+   ioq_write(&w->q, f->out, wr->buf, wr->len, wr->offset, (unsigned long)wr);
+}
+
+static void handle_completion(WORKER *w, IOCOMPLETION *c)
+{
+   WRITE *wr;
+   FILEWORK *f;
+   ssize_t n;
+   int done;
+
+   if (c->tag & 1)  {
+      w->blocks[c->tag >> 1].result = c->result;
+      return;
+      }
+
+   wr = (WRITE *)c->tag;
+   f = &w->files[wr->file];
+   done = c->result;
+   /* finish a short write by hand */
+   while (done >= 0 && (unsigned int)done < wr->len)  {
+      n = pwrite(f->out, wr->buf + done, wr->len - done, wr->offset + done);
+      if (n < 0 && errno == EINTR)
+         continue;
+      done = n <= 0 ? -1 : done + n;
+      }
+   if (done < 0 && !f->error)  {
+      fprintf(stderr, "kstem-file: couldn't write %s\n", f->out_name);
+      f->error = 1;
+      failed = 1;
+      }
+   free(wr->buf);
+   free(wr);
+   if (--f->writes == 0 && f->finished)
+      release_file(w, f);
+}
+
+
+/* open the next file in the thread's queue (or another's) to read ahead
+   into.  Returns the FILEWORK, or -1 if there are no files left, or none
+   can be opened until the blocks in flight are stemmed.  A compressed file
+   is stemmed here and now instead, while the reads already in flight go
+   on.  With every FILEWORK taken and nothing left to read, the files are
+   only waiting for their last writes, so those are collected to free one
+   (otherwise the worker would stop with files still in its queue). */
+
+static int open_next_file(WORKER *w)
+{
+   unsigned char magic[ZIO_MAGIC];
+   FILEWORK *f;
+   int slot, j, format;
+   ssize_t n;
+
+   while (!w->no_more_jobs)  {
+      for (slot = 0; slot < MAX_OPEN && w->in_use[slot]; slot++)
+         ;
+      if (slot == MAX_OPEN)  {
+         if (w->count > 0 || w->q.inflight == 0)
+            return -1;
+         collect(w);
+         continue;
+         }
+      if ((j = next_job(w->me)) < 0)  {
+         w->no_more_jobs = 1;
+         break;
+         }
+      f = &w->files[slot];
+      memset(f, 0, sizeof(FILEWORK));
+      f->job = j;
+      f->size = jobs[j].size;
+      f->out = -1;
+      f->in = open(jobs[j].path, O_RDONLY);
+      if (f->in < 0)  {
+         fprintf(stderr, "kstem-file: couldn't open the input file: %s\n", jobs[j].path);
+         failed = 1;
+         continue;
+         }
+      n = pread(f->in, magic, ZIO_MAGIC, 0);
+      format = zio_format(magic, n < 0 ? 0 : n);
+      if (output_dir)  {
+         f->out_name = output_path(jobs[j].path, format);
+         if (!f->out_name || make_parents(f->out_name) != 0
+             || (f->out = open(f->out_name, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0)  {
+            fprintf(stderr, "kstem-file: couldn't write the stems of %s\n", jobs[j].path);
+            failed = 1;
+            close(f->in);
+            free(f->out_name);
+            continue;
+            }
+         if (compress != ZIO_NONE)
+            f->zw = zw_open(compress);
+         }
+      w->in_use[slot] = 1;
+      if (format != ZIO_NONE)  {
+         stem_compressed(w, f, format);
+         continue;
+         }
+      return slot;
+      }
+   return -1;
+}
+
+/* issue reads until QUEUE_DEPTH blocks are in flight or nothing is left */
+
+static void read_ahead(WORKER *w)
+{
+   FILEWORK *f;
+   BLOCK *b;
+   unsigned int i;
+
+   while (w->count < QUEUE_DEPTH)  {
+      if (w->reading < 0 && (w->reading = open_next_file(w)) < 0)
+         return;
+      f = &w->files[w->reading];
+      while (ioq_full(&w->q))
+         collect(w);
+      i = (w->head + w->count++) % QUEUE_DEPTH;
+      b = &w->blocks[i];
+      b->file = w->reading;
+      b->offset = f->next;
+      b->want = READ_SIZE;
+      b->result = PENDING;
+      ioq_read(&w->q, f->in, b->buf, b->want, b->offset, READ_TAG(i));
+      f->next += READ_SIZE;
+      f->blocks++;
+      /* an empty file still gets one read, which finds the end */
+      if (f->next >= f->size)  {
+         f->all_read = 1;
+         w->reading = -1;
+         }
+      }
+}
+
+
+/* stem a block of the file.  The word carried from the last block is
+   completed by the start of this one. */
+
+static void stem_block(FILEWORK *f, const char *data, size_t len, int last)
+{
+   size_t p = 0, cut;
+
+   if (f->carry.len > 0)  {
+      while (p < len && !isspace((unsigned char)data[p]))
+         p++;
+      put(&f->carry, data, p);
+      if (p == len && !last)
+         return;
+      kstem_spans(f->carry.buf, f->carry.len, put_stem, &f->stems);
+      f->carry.len = 0;
+      }
+   cut = len;
+   if (!last)
+      while (cut > p && !isspace((unsigned char)data[cut-1]))
+         cut--;
+   kstem_spans(data + p, cut - p, put_stem, &f->stems);
+   put(&f->carry, data + cut, len - cut);
+}
+
+/* copy the stems held in a temporary file to out (output_lock held) */
+
+static void copy_spilled(FILE *spill)
+{
+   char buf[64 * 1024];
+   size_t n;
+
+   rewind(spill);
+   while ((n = fread(buf, 1, sizeof(buf), spill)) > 0)
+      fwrite(buf, 1, n, out);
+   if (ferror(spill))  {
+      fprintf(stderr, "kstem-file: couldn't read back a temporary file\n");
+      failed = 1;
+      }
+   fclose(spill);
+}
+
+/* send the stems collected so far to the standard output: straight to out
+   if the job has it (taking it if no other job does), or else to the job's
+   temporary file.  A finished job gives out up, and the jobs that finished
+   in the meantime are copied out after it. */
+
+static void print_stems(FILEWORK *f, int finish)
+{
+   const char *path = jobs[f->job].path;
+   unsigned int i;
+   int mine;
+
+   pthread_mutex_lock(&output_lock);
+   if (headers && output_owner < 0 && f->spill == NULL)  {
+      output_owner = f->job;
+      fprintf(out, "==> %s <==\n", path);
+      }
+   mine = !headers || output_owner == f->job;
+   if (mine)  {
+      fwrite(f->stems.buf, 1, f->stems.len, out);
+      f->stems.len = 0;
+      }
+   pthread_mutex_unlock(&output_lock);
+
+   if (!mine)  {
+      if (f->spill == NULL)  {
+         if ((f->spill = tmpfile()) == NULL)  {
+            fprintf(stderr, "kstem-file: couldn't create a temporary file for the stems of %s\n", path);
+            exit(1);
+            }
+         fprintf(f->spill, "==> %s <==\n", path);
+         }
+      fwrite(f->stems.buf, 1, f->stems.len, f->spill);
+      f->stems.len = 0;
+      }
+   if (!finish)
+      return;
+
+   pthread_mutex_lock(&output_lock);
+   if (output_owner == f->job)
+      output_owner = -1;
+   if (f->spill)  {
+      if (nspilled == spilled_cap)  {
+         spilled_cap = spilled_cap ? spilled_cap * 2 : 16;
+         spilled = (FILE **)realloc(spilled, spilled_cap * sizeof(FILE *));
+         }
+      spilled[nspilled++] = f->spill;
+      f->spill = NULL;
+      }
+   if (output_owner < 0)  {
+      for (i = 0; i < nspilled; i++)
+         copy_spilled(spilled[i]);
+      nspilled = 0;
+      }
+   pthread_mutex_unlock(&output_lock);
+}
+
+static void finish_file(WORKER *w, FILEWORK *f)
+{
+   close(f->in);
+   if (f->error)
+      failed = 1;
+   f->finished = 1;
+   if (output_dir)  {
+      write_stems(w, f, 1);
+      if (f->writes == 0)
+         release_file(w, f);
+      return;
+      }
+   print_stems(f, 1);
+   release_file(w, f);
+}
+/* pass on the stems collected so far, with the file not yet finished */
+
+static void output_stems(WORKER *w, FILEWORK *f)
+{
+   if (output_dir)
+      write_stems(w, f, 0);
+   else
+      print_stems(f, 0);
+}
+
+/* the block at the head has arrived: stem it */
+
+static void stem_next_block(WORKER *w)
+{
+   BLOCK *b = &w->blocks[w->head];
+   FILEWORK *f = &w->files[b->file];
+   unsigned int got;
+   ssize_t n;
+   int last;
+
+   f->done++;
+   last = f->all_read && f->done == f->blocks;
+   if (b->result < 0)  {
+      if (!f->error)
+         fprintf(stderr, "kstem-file: error reading %s\n", jobs[f->job].path);
+      f->error = 1;
+      }
+   else if (!f->error)  {
+      /* a short read before the end of the file is finished by hand */
+      got = b->result;
+      while (got < b->want && b->offset + got < f->size)  {
+         n = pread(f->in, b->buf + got, b->want - got, b->offset + got);
+         if (n < 0 && errno == EINTR)
+            continue;
+         if (n <= 0)
+            break;
+         got += n;
+         }
+      stem_block(f, b->buf, got, last);
+      if (f->stems.len >= WRITE_SIZE)
+         output_stems(w, f);
+      }
+   if (last)
+      finish_file(w, f);
+   w->head = (w->head + 1) % QUEUE_DEPTH;
+   w->count--;
+}
+
+/* a compressed file, decompressed on a thread of its own and stemmed a
+   block at a time as the blocks are handed over */
+
+static void stem_compressed(WORKER *w, FILEWORK *f, int format)
+{
+   const char *path = jobs[f->job].path, *block;
+   ZREADER *z = zr_open(f->in, format, NULL, 0);
+   ssize_t n;
+
+   if (z == NULL)  {
+      fprintf(stderr, "kstem-file: %s is compressed with zstd, which kstem-file was built without\n", path);
+      f->error = 1;
+      }
+   else  {
+      while ((n = zr_next(z, &block)) > 0)  {
+         stem_block(f, block, n, 0);
+         if (f->stems.len >= WRITE_SIZE)
+            output_stems(w, f);
+         }
+      if (n < 0)  {
+         fprintf(stderr, "kstem-file: %s is corrupt or couldn't be read\n", path);
+         f->error = 1;
+         }
+      zr_close(z);
+      }
+   stem_block(f, "", 0, 1);
+   finish_file(w, f);
+}
+
+static void *worker(void *arg)
+{
+   WORKER *w = (WORKER *)calloc(1, sizeof(WORKER));
+   unsigned int i;
+
+   w->me = (int)(long)arg;
+   w->reading = -1;
+   kstem_set_profile(profile);
+   ioq_init(&w->q, 2 * QUEUE_DEPTH, io_backend);
+   if (getenv("KSTEM_TIMING") && w->me == 0)
+      fprintf(stderr, "kstem-file: reading with %s\n", ioq_backend(&w->q));
+   for (i = 0; i < QUEUE_DEPTH; i++)
+      w->blocks[i].buf = (char *)malloc(READ_SIZE);
+
+   read_ahead(w);
+   while (w->count > 0)  {
+      while (w->blocks[w->head].result == PENDING)
+         collect(w);
+      stem_next_block(w);
+      read_ahead(w);
+      }
+   while (w->q.inflight > 0)       /* the last writes */
+      collect(w);
+   if (!w->no_more_jobs)  {
+      fprintf(stderr, "kstem-file: a thread stopped with files still to stem\n");
+      failed = 1;
+      }
+
+   for (i = 0; i < QUEUE_DEPTH; i++)
+      free(w->blocks[i].buf);
+   ioq_free(&w->q);
+   free(w);
+   return NULL;
+}
+
+
+static void usage()
+{
+   fprintf(stderr, "usage: kstem-file [-j threads] [-o output-dir] [-f list-file] [-z gzip|zstd]\n"
+                   "                  [--io=uring|read] [--profile=profile] file-or-directory ...\n");
+   exit(1);
+}
 
 int main (int argc, char *argv[]) {
 
-   char word[80];
-   char thestem[80];
+   static struct option options[] = {
+      { "threads", required_argument, NULL, 'j' },
+      { "output-dir", required_argument, NULL, 'o' },
+      { "files-from", required_argument, NULL, 'f' },
+      { "io", required_argument, NULL, 'i' },
+      { "compress", required_argument, NULL, 'z' },
+      { "profile", required_argument, NULL, 'p' },
+      { NULL, 0, NULL, 0 } };
+   pthread_t threads[MAX_THREADS];
+   const char *files_from = NULL;
+   int i, c;
 
-   FILE *fd;
+   nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+   while ((c = getopt_long(argc, argv, "j:o:f:z:", options, NULL)) != -1)  {
+      switch (c)  {
+         case 'j':
+            nthreads = atoi(optarg);
+            break;
+         case 'o':
+            output_dir = optarg;
+            break;
+         case 'f':
+            files_from = optarg;
+            break;
+         case 'i':
+            if (strcmp(optarg, "uring") == 0)
+               io_backend = IOQ_URING;
+            else if (strcmp(optarg, "read") == 0)
+               io_backend = IOQ_READ;
+            else
+               usage();
+            break;
+         case 'z':
+            if ((compress = zio_format_named(optarg)) < 0)  {
+               fprintf(stderr, "kstem-file: can't compress with %s\n", optarg);
+               exit(1);
+               }
+            break;
+         case 'p':
+            if ((i = kstem_parse_profile(optarg)) < 0)  {
+               fprintf(stderr, "kstem-file: unknown profile %s\n", optarg);
+               exit(1);
+               }
+            profile = i;
+            break;
+         default:
+            usage();
+         }
+      }
+   if (optind == argc && files_from == NULL)
+      usage();
+   if (nthreads < 1)
+      nthreads = 1;
+   if (nthreads > MAX_THREADS)
+      nthreads = MAX_THREADS;
 
-   fd = fopen(argv[1], "r");
-   if (!fd) {
-     printf("Couldn't open the input file: %s", argv[1]);
-     exit(1);
-    }
+   for (i = optind; i < argc; i++)
+      add_path(argv[i]);
+   if (files_from)
+      add_files_from(files_from);
+   headers = njobs > 1;
+   if (output_dir && mkdir(output_dir, 0777) != 0 && errno != EEXIST)  {
+      fprintf(stderr, "kstem-file: couldn't create %s\n", output_dir);
+      exit(1);
+      }
 
    read_dict_info();
-   
-   fscanf(fd, "%s", word);
-   while (!feof(fd)) {
-     stem(word, thestem);
-     printf("%s\n", thestem);
-     fscanf(fd, "%s", word);
-   }
-
-   fclose(fd);
+
+   if (nthreads > (int)njobs)
+      nthreads = njobs > 0 ? njobs : 1;
+   deal_jobs();
+   out = output_dir ? stdout : zio_output(stdout, compress);
+   for (i = 0; i < nthreads; i++)
+      pthread_create(&threads[i], NULL, worker, (void *)(long)i);
+   for (i = 0; i < nthreads; i++)
+      pthread_join(threads[i], NULL);
+   if (out != stdout && fclose(out) != 0)  {
+      fprintf(stderr, "kstem-file: couldn't write the output\n");
+      failed = 1;
+      }
+   return failed ? 1 : 0;
 }
@@ -0,0 +1,264 @@
+/*
+ * Asynchronous reads and writes (see kstem-io.h).
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include "kstem-io.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+
+static void init_fallback(IOQUEUE *q)
+{
+  q->ring_fd = -1;
+  q->done = (IOCOMPLETION *)malloc(q->depth * sizeof(IOCOMPLETION));
+  q->done_head = q->ndone = 0;
+}
+
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+
+static int setup_ring(IOQUEUE *q)
+{
+  struct io_uring_params p;
+  char *sq, *cq;
+  int fd;
+
+  memset(&p, 0, sizeof(p));
+  fd = syscall(__NR_io_uring_setup, q->depth, &p);
+  if (fd < 0)
+    return -1;
+
+  q->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  q->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (q->cq_ring_size > q->sq_ring_size)
+	q->sq_ring_size = q->cq_ring_size;
+      q->cq_ring_size = q->sq_ring_size;
+    }
+  q->sq_ring = mmap(NULL, q->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		    fd, IORING_OFF_SQ_RING);
+  if (q->sq_ring == MAP_FAILED)
+    {
+      close(fd);
+      return -1;
+    }
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    q->cq_ring = q->sq_ring;
+  else
+    {
+      q->cq_ring = mmap(NULL, q->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			fd, IORING_OFF_CQ_RING);
+      if (q->cq_ring == MAP_FAILED)
+	{
+	  munmap(q->sq_ring, q->sq_ring_size);
+	  close(fd);
+	  return -1;
+	}
+    }
+  q->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  q->sqes = mmap(NULL, q->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		 fd, IORING_OFF_SQES);
+  if (q->sqes == MAP_FAILED)
+    {
+      munmap(q->sq_ring, q->sq_ring_size);
+      if (q->cq_ring != q->sq_ring)
+	munmap(q->cq_ring, q->cq_ring_size);
+      close(fd);
+      return -1;
+    }
+
+  sq = (char *)q->sq_ring;
+  q->sq_head = (unsigned int *)(sq + p.sq_off.head);
+  q->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+  q->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+  q->sq_array = (unsigned int *)(sq + p.sq_off.array);
+  cq = (char *)q->cq_ring;
+  q->cq_head = (unsigned int *)(cq + p.cq_off.head);
+  q->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+  q->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+  q->cqes = cq + p.cq_off.cqes;
+  q->ring_fd = fd;
+  return 0;
+}
+
+/* put a request in the submission ring; it goes to the kernel at the next
+   ioq_wait() */
+
+static void queue_sqe(IOQUEUE *q, int op, int fd, const void *buf, unsigned int len,
+		      off_t offset, unsigned long tag)
+{
+  unsigned int tail = *q->sq_tail;
+  unsigned int i = tail & *q->sq_mask;
+  struct io_uring_sqe *sqe = &((struct io_uring_sqe *)q->sqes)[i];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = op;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long)buf;
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->user_data = tag;
+  q->sq_array[i] = i;
+  __atomic_store_n(q->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  q->queued++;
+  q->inflight++;
+}
+
+static int uring_wait(IOQUEUE *q, IOCOMPLETION *c)
+{
+  unsigned int head;
+  struct io_uring_cqe *cqe;
+  int n;
+
+  for (;;)
+    {
+      head = *q->cq_head;
+      if (head != __atomic_load_n(q->cq_tail, __ATOMIC_ACQUIRE))
+	{
+	  cqe = &((struct io_uring_cqe *)q->cqes)[head & *q->cq_mask];
+	  c->tag = cqe->user_data;
+	  c->result = cqe->res;
+	  __atomic_store_n(q->cq_head, head + 1, __ATOMIC_RELEASE);
+	  q->inflight--;
+	  return 0;
+	}
+      /* submit whatever is queued, and wait for at least one completion */
+      n = syscall(__NR_io_uring_enter, q->ring_fd, q->queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return -1;
+	}
+      q->queued -= n;
+    }
+}
+
+#define OP_READ  IORING_OP_READ
+#define OP_WRITE IORING_OP_WRITE
+
+#else
+
+static int setup_ring(IOQUEUE *q)
+{
+  return -1;
+}
+
+static void queue_sqe(IOQUEUE *q, int op, int fd, const void *buf, unsigned int len,
+		      off_t offset, unsigned long tag)
+{
+}
+
+static int uring_wait(IOQUEUE *q, IOCOMPLETION *c)
+{
+  return -1;
+}
+
+#define OP_READ  0
+#define OP_WRITE 1
+
+#endif
+
+
+int ioq_init(IOQUEUE *q, unsigned int depth, int backend)
+{
+  memset(q, 0, sizeof(IOQUEUE));
+  q->depth = depth;
+  q->ring_fd = -1;
+  if (backend == IOQ_URING && setup_ring(q) == 0)
+    return 0;
+  init_fallback(q);
+  return 0;
+}
+
+void ioq_free(IOQUEUE *q)
+{
+  if (q->ring_fd >= 0)
+    {
+      munmap(q->sqes, q->sqes_size);
+      if (q->cq_ring != q->sq_ring)
+	munmap(q->cq_ring, q->cq_ring_size);
+      munmap(q->sq_ring, q->sq_ring_size);
+      close(q->ring_fd);
+    }
+  free(q->done);
+}
+
+const char *ioq_backend(const IOQUEUE *q)
+{
+  return q->ring_fd >= 0 ? "io_uring" : "pread";
+}
+
+/* is there no room for another request until one is collected? */
+
+int ioq_full(const IOQUEUE *q)
+{
+  return q->inflight >= q->depth;
+}
+
+
+/* without io_uring, do the request now and keep its result for ioq_wait() */
+
+static int fallback(IOQUEUE *q, int op, int fd, const void *buf, unsigned int len,
+		    off_t offset, unsigned long tag)
+{
+  ssize_t n;
+  IOCOMPLETION *c = &q->done[(q->done_head + q->ndone) % q->depth];
+
+  do
+    n = op == OP_READ ? pread(fd, (void *)buf, len, offset) : pwrite(fd, buf, len, offset);
+  while (n < 0 && errno == EINTR);
+  c->tag = tag;
+  c->result = n < 0 ? -errno : (int)n;
+  q->ndone++;
+  q->inflight++;
+  return 0;
+}
+
+int ioq_read(IOQUEUE *q, int fd, void *buf, unsigned int len, off_t offset, unsigned long tag)
+{
+  if (ioq_full(q))
+    return -1;
+  if (q->ring_fd < 0)
+    return fallback(q, OP_READ, fd, buf, len, offset, tag);
+  queue_sqe(q, OP_READ, fd, buf, len, offset, tag);
+  return 0;
+}
+
+int ioq_write(IOQUEUE *q, int fd, const void *buf, unsigned int len, off_t offset, unsigned long tag)
+{
+  if (ioq_full(q))
+    return -1;
+  if (q->ring_fd < 0)
+    return fallback(q, OP_WRITE, fd, buf, len, offset, tag);
+  queue_sqe(q, OP_WRITE, fd, buf, len, offset, tag);
+  return 0;
+}
+
+
+/* collect a completed request, waiting for one if need be.  Returns -1 if
+   nothing is in flight. */
+
+int ioq_wait(IOQUEUE *q, IOCOMPLETION *c)
+{
+  if (q->inflight == 0)
+    return -1;
+  if (q->ring_fd >= 0)
+    return uring_wait(q, c);
+  *c = q->done[q->done_head];
+  q->done_head = (q->done_head + 1) % q->depth;
+  q->ndone--;
+  q->inflight--;
+  return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * An asynchronous queue of reads and writes, for keeping many requests in
+ * flight while the stemmer works on the data that has already arrived.
+ *
+ * On Linux the queue is an io_uring (set up with the raw system calls, so
+ * no library is needed).  Where io_uring isn't available -- an old kernel,
+ * a sandbox that forbids it, or IOQ_READ asked for -- each request is done
+ * with pread() or pwrite() as it is queued, and completes at once, so the
+ * caller sees the same behavior either way.
+ *
+ * A request carries a tag of the caller's choosing, which is returned with
+ * its result (the byte count, or -errno).
+ */
+
+#define IOQ_URING 0     /* io_uring if possible, otherwise pread/pwrite */
+#define IOQ_READ  1     /* always pread/pwrite */
+
+typedef struct
+{
+  unsigned long tag;
+  int result;
+} IOCOMPLETION;
+
+typedef struct
+{
+  int ring_fd;                 /* -1 when requests are done with pread/pwrite */
+  unsigned int depth;          /* requests that can be in flight at once */
+  unsigned int inflight;
+  unsigned int queued;         /* in the submission ring, not yet submitted */
+
+  /* the io_uring rings, shared with the kernel */
+  unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned int *cq_head, *cq_tail, *cq_mask;
+  void *sqes;
+  void *cqes;
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_size, cq_ring_size, sqes_size;
+
+  /* requests already done by pread/pwrite, waiting to be collected */
+  IOCOMPLETION *done;
+  unsigned int done_head, ndone;
+} IOQUEUE;
+
+
+int ioq_init(IOQUEUE *q, unsigned int depth, int backend);
+void ioq_free(IOQUEUE *q);
+const char *ioq_backend(const IOQUEUE *q);
+int ioq_full(const IOQUEUE *q);
+int ioq_read(IOQUEUE *q, int fd, void *buf, unsigned int len, off_t offset, unsigned long tag);
+int ioq_write(IOQUEUE *q, int fd, const void *buf, unsigned int len, off_t offset, unsigned long tag);
+int ioq_wait(IOQUEUE *q, IOCOMPLETION *c);
@@ -0,0 +1,202 @@
+/*
+ * Framing routines for the kstemd protocol (see kstem-proto.h).
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "kstem-proto.h"
+
+#define HEADER_LENGTH 8     /* frame length + word count */
+
+
+static void put32(char *p, unsigned int v)
+{
+   v = htonl(v);
+   memcpy(p, &v, 4);
+}
+
+static unsigned int get32(const char *p)
+{
+   unsigned int v;
+
+   memcpy(&v, p, 4);
+   return ntohl(v);
+}
+
+
+/* make sure there is room for n more bytes in the frame */
+
+static int reserve(BATCH *b, unsigned int n)
+{
+   unsigned int cap;
+   char *p;
+
+   if (b->len + n - 4 > KSTEM_MAX_FRAME)
+      return -1;
+   if (b->len + n <= b->cap)
+      return 0;
+   cap = b->cap ? b->cap : 4096;
+   while (cap < b->len + n)
+      cap *= 2;
+   p = (char *)realloc(b->buf, cap);
+   if (!p)
+      return -1;
+   b->buf = p;
+   b->cap = cap;
+   return 0;
+}
+
+
+/* read or write exactly len bytes, retrying after short transfers */
+
+static int read_full(int fd, char *buf, size_t len)
+{
+   size_t done = 0;
+   ssize_t n;
+
+   while (done < len)  {
+      n = read(fd, buf + done, len - done);
+      if (n == 0)
+         return done == 0 ? 0 : -1;
+      if (n < 0)  {
+         if (errno == EINTR)
+            continue;
+         return -1;
+         }
+      done += n;
+      }
+   return 1;
+}
+
+static int write_full(int fd, const char *buf, size_t len)
+{
+   ssize_t n;
+
+   while (len > 0)  {
+      n = write(fd, buf, len);
+      if (n < 0)  {
+         if (errno == EINTR)
+            continue;
+         return -1;
+         }
+      buf += n;
+      len -= n;
+      }
+   return 0;
+}
+
+
+
+void batch_init(BATCH *b)
+{
+   memset(b, 0, sizeof(BATCH));
+   batch_reset(b);
+}
+
+void batch_free(BATCH *b)
+{
+   free(b->buf);
+   memset(b, 0, sizeof(BATCH));
+}
+
+/* empty the frame, ready for new words to be added */
+
+void batch_reset(BATCH *b)
+{
+   b->len = 0;
+   b->count = 0;
+   b->pos = HEADER_LENGTH;
+   if (reserve(b, HEADER_LENGTH) == 0)
+      b->len = HEADER_LENGTH;
+}
+
+
+/* append a word to the frame.  Returns -1 if the word is too long or the
+   frame would grow past KSTEM_MAX_FRAME. */
+
+int batch_add(BATCH *b, const char *word, unsigned int len)
+{
+   unsigned short n;
+
+   if (len > KSTEM_MAX_TOKEN || reserve(b, len + 2) != 0)
+      return -1;
+   n = htons((unsigned short)len);
+   memcpy(b->buf + b->len, &n, 2);
+   memcpy(b->buf + b->len + 2, word, len);
+   b->len += len + 2;
+   b->count++;
+   return 0;
+}
+
+
+/* make the frame an error reply carrying message */
+
+void batch_error(BATCH *b, const char *message)
+{
+   size_t len = strlen(message);
+
+   batch_reset(b);
+   batch_add(b, message, len > KSTEM_MAX_TOKEN ? KSTEM_MAX_TOKEN : len);
+   b->count = KSTEM_ERROR_COUNT;
+}
+
+
+int batch_send(int fd, BATCH *b)
+{
+   put32(b->buf, b->len - 4);
+   put32(b->buf + 4, b->count);
+   return write_full(fd, b->buf, b->len);
+}
+
+
+/* read one frame.  Returns 1 if a frame was read, 0 at a clean end of file,
+   and -1 on an error or a malformed frame. */
+
+int batch_recv(int fd, BATCH *b)
+{
+   char header[HEADER_LENGTH];
+   unsigned int payload;
+   int r;
+
+   r = read_full(fd, header, HEADER_LENGTH);
+   if (r <= 0)
+      return r;
+   payload = get32(header);
+   if (payload < 4 || payload > KSTEM_MAX_FRAME)
+      return -1;
+
+   b->len = 0;
+   if (reserve(b, payload + 4) != 0)
+      return -1;
+   memcpy(b->buf, header, HEADER_LENGTH);
+   if (read_full(fd, b->buf + HEADER_LENGTH, payload - 4) != 1 && payload > 4)
+      return -1;
+   b->len = payload + 4;
+   b->count = get32(header + 4);
+   b->pos = HEADER_LENGTH;
+   return 1;
+}
+
+
+/* step through the words of a received frame.  The word is not
+   '\0'-terminated; it points into the frame buffer. */
+
+int batch_next(BATCH *b, const char **word, unsigned int *len)
+{
+   unsigned short n;
+
+   if (b->pos + 2 > b->len)
+      return 0;
+   memcpy(&n, b->buf + b->pos, 2);
+   n = ntohs(n);
+   if (b->pos + 2 + n > b->len)
+      return 0;
+   *word = b->buf + b->pos + 2;
+   *len = n;
+   b->pos += 2 + n;
+   return 1;
+}
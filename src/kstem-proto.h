@@ -0,0 +1,44 @@
+/*
+ * Wire protocol shared by kstemd (the resident stemming daemon) and the
+ * client mode of kstem.
+ *
+ * Every message, in either direction, is a frame:
+ *
+ *     u32 payload length
+ *     u32 number of words
+ *     for each word:  u16 length, followed by that many bytes (no '\0')
+ *
+ * All integers are in network byte order.  A request carries the words to
+ * be stemmed; the reply carries their stems, in the same order.
+ *
+ * A request that can't be answered (say, because its stems won't fit in a
+ * frame) gets an error reply instead: its word count is KSTEM_ERROR_COUNT,
+ * and its one word is a message saying what went wrong.  The connection
+ * stays open.
+ */
+
+#define KSTEM_SOCKET_DEFAULT "/tmp/kstemd.sock"
+#define KSTEM_MAX_FRAME      (16*1024*1024)   /* largest payload we accept */
+#define KSTEM_MAX_TOKEN      65535            /* longest word in a frame */
+#define KSTEM_ERROR_COUNT    0xffffffffu      /* word count of an error reply */
+
+
+/* a frame being built or parsed */
+typedef struct
+{
+  char *buf;             /* 4 bytes of frame length, then the payload */
+  unsigned int len;      /* bytes used in buf */
+  unsigned int cap;      /* bytes allocated for buf */
+  unsigned int count;    /* number of words in the frame */
+  unsigned int pos;      /* read position while parsing */
+} BATCH;
+
+
+void batch_init(BATCH *b);
+void batch_free(BATCH *b);
+void batch_reset(BATCH *b);
+int batch_add(BATCH *b, const char *word, unsigned int len);
+void batch_error(BATCH *b, const char *message);
+int batch_send(int fd, BATCH *b);
+int batch_recv(int fd, BATCH *b);
+int batch_next(BATCH *b, const char **word, unsigned int *len);
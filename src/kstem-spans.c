@@ -0,0 +1,158 @@
+/*
+ * Stemming the tokens of a buffer in place (see kstem_spans() in kstem.h),
+ * or of a stream of buffers (kstem_stream_next()).
+ *
+ * The tokens are found without copying the buffer; each is copied only into
+ * a term for stem(), which needs a '\0'-terminated string.  A stream's
+ * token that runs to the end of a piece is carried over in the same term,
+ * and completed by the pieces after it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "kstem.h"
+
+
+/* the characters kstem splits words on: white space, as isspace() has it
+   in the "C" locale (so form feeds and vertical tabs too) */
+
+static int is_separator(unsigned char c)
+{
+  return isspace(c) != 0;
+}
+
+
+/* storage for a term and its stem, grown as longer tokens come along */
+
+static void grow(char **buf, size_t *size, size_t need)
+{
+  if (need > *size)
+    {
+      *size = need * 2;
+      *buf = (char *)realloc(*buf, *size);
+    }
+}
+
+static __thread char *term = NULL;
+static __thread char *thestem = NULL;
+static __thread size_t term_size = 0, stem_size = 0;
+
+static void make_room(size_t len)
+{
+  grow(&term, &term_size, len + 1);
+  grow(&thestem, &stem_size, kstem_stem_size(len));
+}
+
+
+size_t kstem_spans(const char *text, size_t len, KSTEM_SPAN_FN fn, void *arg)
+{
+  KSTEM_SPAN span;
+  size_t i = 0, n = 0;
+
+  while (i < len)
+    {
+      while (i < len && is_separator(text[i]))
+	i++;
+      if (i == len)
+	break;
+      span.start = i;
+      while (i < len && !is_separator(text[i]))
+	i++;
+      span.length = i - span.start;
+
+      make_room(span.length);
+      memcpy(term, text + span.start, span.length);
+      term[span.length] = '\0';
+      stem(term, thestem);
+      span.stem = thestem;
+      span.stem_length = strlen(thestem);
+      span.text = text + span.start;
+      fn(&span, arg);
+      n++;
+    }
+  return n;
+}
+
+
+struct kstem_stream
+{
+  const char *data;            /* the piece being read */
+  size_t len, pos;
+  size_t base;                 /* the offset of the piece in the stream */
+  int ended;                   /* the piece is the end of the stream */
+  char *term;                  /* the token, which may have been carried over */
+  size_t term_len, term_size;
+  size_t term_start;           /* its offset in the stream */
+  char *thestem;
+  size_t stem_size;
+};
+
+KSTEM_STREAM *kstem_stream_new()
+{
+  return (KSTEM_STREAM *)calloc(1, sizeof(KSTEM_STREAM));
+}
+
+void kstem_stream_free(KSTEM_STREAM *s)
+{
+  free(s->term);
+  free(s->thestem);
+  free(s);
+}
+
+void kstem_stream_write(KSTEM_STREAM *s, const char *data, size_t len)
+{
+  s->base += s->len;
+  s->data = data;
+  s->len = data ? len : 0;
+  s->pos = 0;
+  s->ended = data == NULL;
+}
+
+/* add data[0..len) to the token */
+
+static void carry(KSTEM_STREAM *s, const char *data, size_t len)
+{
+  if (len == 0)
+    return;
+  grow(&s->term, &s->term_size, s->term_len + len + 1);
+  memcpy(s->term + s->term_len, data, len);
+  s->term_len += len;
+}
+
+int kstem_stream_next(KSTEM_STREAM *s, KSTEM_SPAN *span)
+{
+  size_t i = s->pos, start;
+
+  if (s->term_len == 0)
+    {
+      while (i < s->len && is_separator(s->data[i]))
+	i++;
+      s->term_start = s->base + i;
+    }
+  /* the token (or the rest of the one carried over) */
+  start = i;
+  while (i < s->len && !is_separator(s->data[i]))
+    i++;
+  s->pos = i;
+  carry(s, s->data + start, i - start);
+
+  if (s->term_len == 0 || (i == s->len && !s->ended))
+    {
+      /* the piece is used up; the stream may start again after its end */
+      if (s->ended)
+	s->base = s->len = s->pos = s->ended = 0;
+      return 0;
+    }
+
+  s->term[s->term_len] = '\0';
+  grow(&s->thestem, &s->stem_size, kstem_stem_size(s->term_len));
+  stem(s->term, s->thestem);
+  span->start = s->term_start;
+  span->length = s->term_len;
+  span->stem = s->thestem;
+  span->stem_length = strlen(s->thestem);
+  span->text = s->term;
+  s->term_len = 0;
+  return 1;
+}
@@ -0,0 +1,184 @@
+/*
+ * Recording and reading traces of tokens (see kstem-trace.h).
+ *
+ * The writer numbers the tokens with an exact tally (kstem-counts.h), whose
+ * entries are numbered in the order the words first came.  Which tokens are
+ * kept is decided by a fixed sequence of random numbers, so capturing the
+ * same input at the same rate gives the same trace.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "kstem.h"
+#include "kstem-counts.h"
+#include "kstem-trace.h"
+
+
+static void put_varint(FILE *f, unsigned long long v)
+{
+  while (v >= 0x80)
+    {
+      putc((int)(v & 0x7f) | 0x80, f);
+      v >>= 7;
+    }
+  putc((int)v, f);
+}
+
+/* 1, 0 at the end of the file, or -1 if it ends in the middle */
+
+static int get_varint(FILE *f, unsigned long long *v)
+{
+  int c, shift = 0;
+
+  *v = 0;
+  while ((c = getc(f)) != EOF)
+    {
+      *v |= (unsigned long long)(c & 0x7f) << shift;
+      if (!(c & 0x80))
+	return 1;
+      if ((shift += 7) >= 64)
+	return -1;
+    }
+  return shift == 0 ? 0 : -1;
+}
+
+
+/* start a trace in path, to keep each token offered with probability rate */
+
+TRACE_WRITER *trace_create(const char *path, double rate)
+{
+  unsigned int header[4];
+  TRACE_WRITER *t;
+  FILE *f;
+
+  if ((f = fopen(path, "wb")) == NULL)
+    return NULL;
+  t = (TRACE_WRITER *)calloc(1, sizeof(TRACE_WRITER));
+  t->f = f;
+  tally_init(&t->tokens, 0);
+  t->random = 0x9e3779b97f4a7c15ULL;
+  t->threshold = (unsigned long long)(rate * 4294967296.0);
+
+  memcpy(&header[0], TRACE_MAGIC, 4);
+  header[1] = htonl(TRACE_VERSION);
+  header[2] = htonl((unsigned int)(rate * 1000000.0 + 0.5));
+  header[3] = 0;
+  fwrite(header, sizeof(header), 1, f);
+  return t;
+}
+
+void trace_token(TRACE_WRITER *t, const char *token, size_t len)
+{
+  unsigned int before = t->tokens.n, id;
+
+  t->offered++;
+  /* xorshift64* */
+  t->random ^= t->random >> 12;
+  t->random ^= t->random << 25;
+  t->random ^= t->random >> 27;
+  if (((t->random * 2685821657736338717ULL) >> 32) >= t->threshold)
+    return;
+
+  t->kept++;
+  id = tally_add(&t->tokens, token, len, 1, 0);
+  if (t->tokens.n > before)
+    {
+      put_varint(t->f, (unsigned long long)len << 1);
+      fwrite(token, 1, len, t->f);
+    }
+  else
+    put_varint(t->f, ((unsigned long long)id << 1) | 1);
+}
+
+/* finish the trace; returns 0, or -1 if it couldn't be written */
+
+int trace_close(TRACE_WRITER *t)
+{
+  int status = ferror(t->f) ? -1 : 0;
+
+  if (fclose(t->f) != 0)
+    status = -1;
+  tally_free(&t->tokens);
+  free(t);
+  return status;
+}
+
+
+/* open a trace to read; NULL if there is none, or it isn't a trace */
+
+TRACE_READER *trace_open(const char *path)
+{
+  unsigned int header[4];
+  TRACE_READER *t;
+  FILE *f;
+
+  if ((f = fopen(path, "rb")) == NULL)
+    return NULL;
+  if (fread(header, sizeof(header), 1, f) != 1 || memcmp(&header[0], TRACE_MAGIC, 4) != 0
+      || ntohl(header[1]) != TRACE_VERSION)
+    {
+      fclose(f);
+      return NULL;
+    }
+  t = (TRACE_READER *)calloc(1, sizeof(TRACE_READER));
+  t->f = f;
+  t->rate_ppm = ntohl(header[2]);
+  return t;
+}
+
+/* the next token of the trace: its number, and its text (which stays put
+   until trace_free()).  Returns 1, 0 at the end, or -1 if the trace is
+   corrupt. */
+
+int trace_next(TRACE_READER *t, unsigned int *id, const char **token, size_t *len)
+{
+  unsigned long long v;
+  int got = get_varint(t->f, &v);
+
+  if (got <= 0)
+    return got;
+  if (v & 1)
+    {
+      if ((v >> 1) >= t->n)
+	return -1;
+      *id = (unsigned int)(v >> 1);
+    }
+  else
+    {
+      if (t->n == t->cap)
+	{
+	  t->cap = t->cap ? t->cap * 2 : 1024;
+	  t->tokens = (char **)realloc(t->tokens, t->cap * sizeof(char *));
+	  t->lengths = (size_t *)realloc(t->lengths, t->cap * sizeof(size_t));
+	}
+      if ((v >> 1) == 0 || (v >> 1) > 0xffffffffULL)
+	return -1;
+      t->lengths[t->n] = (size_t)(v >> 1);
+      t->tokens[t->n] = (char *)malloc(t->lengths[t->n] + 1);
+      if (fread(t->tokens[t->n], 1, t->lengths[t->n], t->f) != t->lengths[t->n])
+	{
+	  free(t->tokens[t->n]);
+	  return -1;
+	}
+      t->tokens[t->n][t->lengths[t->n]] = '\0';
+      *id = t->n++;
+    }
+  *token = t->tokens[*id];
+  *len = t->lengths[*id];
+  return 1;
+}
+
+void trace_free(TRACE_READER *t)
+{
+  unsigned int i;
+
+  fclose(t->f);
+  for (i = 0; i < t->n; i++)
+    free(t->tokens[i]);
+  free(t->tokens);
+  free(t->lengths);
+  free(t);
+}
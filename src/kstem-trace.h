@@ -0,0 +1,47 @@
+/*
+ * Traces of the tokens a stemmer is given, for "kstem --capture" to record
+ * and bench-kstem -T to replay.
+ *
+ * A trace is a sample of the token stream, taken at a given rate, one token
+ * at a time, so it keeps the stream's make-up: how skewed the words are,
+ * and what share of the tokens are numbers, punctuation, long strings or
+ * names.  Since a few words make up most of any stream, each token is
+ * stored once, the first time it is sampled, and after that by its number:
+ *
+ *    header   "KTRC", then the version and the rate in parts per million,
+ *             as 32-bit integers in network byte order, and 4 bytes of 0
+ *    records  a varint v (7 bits a byte, low bits first): if v is odd, a
+ *             repeat of token v >> 1 (numbered from 0 in order of first
+ *             appearance); if even, a new token of v >> 1 bytes, which follow
+ */
+
+#define TRACE_MAGIC "KTRC"
+#define TRACE_VERSION 1
+#define TRACE_HEADER 16
+
+typedef struct
+{
+  FILE *f;
+  TALLY tokens;                /* the tokens so far, numbered in order */
+  unsigned long long random;   /* decides which tokens are kept */
+  unsigned long long threshold;
+  unsigned long offered, kept;
+} TRACE_WRITER;
+
+typedef struct
+{
+  FILE *f;
+  unsigned int rate_ppm;
+  char **tokens;               /* the tokens so far, by number */
+  size_t *lengths;
+  unsigned int n, cap;
+} TRACE_READER;
+
+
+TRACE_WRITER *trace_create(const char *path, double rate);
+void trace_token(TRACE_WRITER *t, const char *token, size_t len);
+int trace_close(TRACE_WRITER *t);
+
+TRACE_READER *trace_open(const char *path);
+int trace_next(TRACE_READER *t, unsigned int *id, const char **token, size_t *len);
+void trace_free(TRACE_READER *t);
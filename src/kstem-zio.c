@@ -0,0 +1,591 @@
+/*
+ * Compressed input and output (see kstem-zio.h).
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "kstem-zio.h"
+
+#define ZBLOCK (256*1024)     /* decompressed block handed to the reader */
+#define NZBLOCKS 4            /* blocks between the thread and the reader */
+#define RAW_SIZE (128*1024)   /* compressed input read at a time */
+
+
+static const unsigned char gzip_magic[] = { 0x1f, 0x8b };
+static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+/* the format of input beginning with magic[0..len) */
+
+int zio_format(const void *magic, size_t len)
+{
+  if (len >= sizeof(gzip_magic) && memcmp(magic, gzip_magic, sizeof(gzip_magic)) == 0)
+    return ZIO_GZIP;
+  if (len >= sizeof(zstd_magic) && memcmp(magic, zstd_magic, sizeof(zstd_magic)) == 0)
+    return ZIO_ZSTD;
+  return ZIO_NONE;
+}
+
+/* could input beginning with magic[0..len) still turn out to be compressed? */
+
+static int magic_prefix(const unsigned char *magic, size_t len)
+{
+  return (len < sizeof(gzip_magic) && memcmp(magic, gzip_magic, len) == 0)
+    || (len < sizeof(zstd_magic) && memcmp(magic, zstd_magic, len) == 0);
+}
+
+/* the format called name ("gzip" or "zstd"), or -1 if it isn't supported */
+
+int zio_format_named(const char *name)
+{
+  if (strcmp(name, "gzip") == 0 || strcmp(name, "gz") == 0)
+    return ZIO_GZIP;
+#ifdef HAVE_ZSTD
+  if (strcmp(name, "zstd") == 0 || strcmp(name, "zst") == 0)
+    return ZIO_ZSTD;
+#endif
+  if (strcmp(name, "none") == 0)
+    return ZIO_NONE;
+  return -1;
+}
+
+const char *zio_suffix(int format)
+{
+  return format == ZIO_GZIP ? ".gz" : format == ZIO_ZSTD ? ".zst" : "";
+}
+
+
+/* ------------------------------- reading ------------------------------- */
+
+struct ZREADER
+{
+  int fd;
+  int format;
+  const char *prefix;          /* bytes already read from fd */
+  size_t prefix_len;
+  char prefix_buf[ZIO_MAGIC];
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t filled, emptied;
+  char *blocks[NZBLOCKS];
+  size_t lens[NZBLOCKS];
+  unsigned int head, count;    /* the full blocks, oldest first */
+  int held;                    /* the reader has blocks[head] */
+  int ended, error, stop;
+};
+
+/* the compressed input: the prefix, then the rest of fd */
+
+static ssize_t raw_read(ZREADER *z, char *buf, size_t cap)
+{
+  ssize_t n;
+
+  if (z->prefix_len > 0)
+    {
+      n = z->prefix_len < cap ? z->prefix_len : cap;
+      memcpy(buf, z->prefix, n);
+      z->prefix += n;
+      z->prefix_len -= n;
+      return n;
+    }
+  do
+    n = read(z->fd, buf, cap);
+  while (n < 0 && errno == EINTR);
+  return n;
+}
+
+/* the next block for the thread to fill, or NULL if the reader has gone */
+
+static char *empty_block(ZREADER *z)
+{
+  char *b;
+
+  pthread_mutex_lock(&z->lock);
+  while (z->count == NZBLOCKS && !z->stop)
+    pthread_cond_wait(&z->emptied, &z->lock);
+  b = z->stop ? NULL : z->blocks[(z->head + z->count) % NZBLOCKS];
+  pthread_mutex_unlock(&z->lock);
+  return b;
+}
+
+static void fill_block(ZREADER *z, size_t len)
+{
+  pthread_mutex_lock(&z->lock);
+  z->lens[(z->head + z->count) % NZBLOCKS] = len;
+  z->count++;
+  pthread_cond_signal(&z->filled);
+  pthread_mutex_unlock(&z->lock);
+}
+
+/* Each of these runs the thread's side for one format, handing a block
+   over when it is full or when the input read so far is used up (so a line
+   typed at a terminal is stemmed at once).  They return 0 if the input
+   ended properly. */
+
+static int copy_all(ZREADER *z)
+{
+  char *out;
+  ssize_t n;
+
+  while ((out = empty_block(z)) != NULL)
+    {
+      if ((n = raw_read(z, out, ZBLOCK)) <= 0)
+        return n < 0 ? -1 : 0;
+      fill_block(z, n);
+    }
+  return 0;
+}
+
+static int inflate_all(ZREADER *z)
+{
+  z_stream s;
+  char *raw = (char *)malloc(RAW_SIZE), *out = NULL;
+  int ret = Z_OK, result = -1;
+  ssize_t n;
+
+  memset(&s, 0, sizeof(s));
+  if (inflateInit2(&s, 15 + 32) != Z_OK)      /* gzip (or zlib) header */
+    return -1;
+  while ((n = raw_read(z, raw, RAW_SIZE)) > 0)
+    {
+      s.next_in = (Bytef *)raw;
+      s.avail_in = n;
+      for (;;)
+        {
+          if (ret == Z_STREAM_END)
+            {
+              if (s.avail_in == 0)
+                break;
+              inflateReset(&s);                 /* another member follows */
+            }
+          if (out == NULL)
+            {
+              if ((out = empty_block(z)) == NULL)
+                goto done;
+              s.next_out = (Bytef *)out;
+              s.avail_out = ZBLOCK;
+            }
+          ret = inflate(&s, Z_NO_FLUSH);
+          if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+            goto done;
+          if (s.avail_out == 0)
+            {
+              fill_block(z, ZBLOCK);
+              out = NULL;
+              continue;
+            }
+          if (s.avail_in == 0)
+            break;
+        }
+      if (out != NULL && s.avail_out < ZBLOCK)
+        {
+          fill_block(z, ZBLOCK - s.avail_out);
+          out = NULL;
+        }
+    }
+  if (n == 0 && ret == Z_STREAM_END)
+    result = 0;
+ done:
+  inflateEnd(&s);
+  free(raw);
+  return result;
+}
+
+#ifdef HAVE_ZSTD
+static int unzstd_all(ZREADER *z)
+{
+  ZSTD_DStream *d = ZSTD_createDStream();
+  char *raw = (char *)malloc(RAW_SIZE);
+  ZSTD_inBuffer in;
+  ZSTD_outBuffer o = { NULL, ZBLOCK, 0 };
+  size_t r = 1;
+  int result = -1;
+  ssize_t n;
+
+  ZSTD_initDStream(d);
+  while ((n = raw_read(z, raw, RAW_SIZE)) > 0)
+    {
+      in.src = raw;
+      in.size = n;
+      in.pos = 0;
+      while (in.pos < in.size || o.pos == o.size)
+        {
+          if (o.dst == NULL)
+            {
+              if ((o.dst = empty_block(z)) == NULL)
+                goto done;
+              o.pos = 0;
+            }
+          r = ZSTD_decompressStream(d, &o, &in);
+          if (ZSTD_isError(r))
+            goto done;
+          if (o.pos == o.size)
+            {
+              fill_block(z, o.pos);
+              o.dst = NULL;
+              o.pos = 0;
+            }
+          else if (in.pos == in.size)
+            break;
+        }
+      if (o.dst != NULL && o.pos > 0)
+        {
+          fill_block(z, o.pos);
+          o.dst = NULL;
+          o.pos = 0;
+        }
+    }
+  if (n == 0 && r == 0)
+    result = 0;
+ done:
+  ZSTD_freeDStream(d);
+  free(raw);
+  return result;
+}
+#endif
+
+static void *decompress(void *arg)
+{
+  ZREADER *z = (ZREADER *)arg;
+  int result;
+
+  if (z->format == ZIO_GZIP)
+    result = inflate_all(z);
+#ifdef HAVE_ZSTD
+  else if (z->format == ZIO_ZSTD)
+    result = unzstd_all(z);
+#endif
+  else
+    result = copy_all(z);
+  pthread_mutex_lock(&z->lock);
+  z->error = result != 0 && !z->stop;
+  z->ended = 1;
+  pthread_cond_signal(&z->filled);
+  pthread_mutex_unlock(&z->lock);
+  return NULL;
+}
+
+/* start reading fd, the first prefix_len bytes of which have already been
+   read into prefix.  Returns NULL if the format isn't supported. */
+
+ZREADER *zr_open(int fd, int format, const void *prefix, size_t prefix_len)
+{
+  ZREADER *z;
+  int i;
+
+#ifndef HAVE_ZSTD
+  if (format == ZIO_ZSTD)
+    return NULL;
+#endif
+  z = (ZREADER *)calloc(1, sizeof(ZREADER));
+  z->fd = fd;
+  z->format = format;
+  if (prefix_len > 0)
+    memcpy(z->prefix_buf, prefix, prefix_len);
+  z->prefix = z->prefix_buf;
+  z->prefix_len = prefix_len;
+  pthread_mutex_init(&z->lock, NULL);
+  pthread_cond_init(&z->filled, NULL);
+  pthread_cond_init(&z->emptied, NULL);
+  for (i = 0; i < NZBLOCKS; i++)
+    z->blocks[i] = (char *)malloc(ZBLOCK);
+  pthread_create(&z->thread, NULL, decompress, z);
+  return z;
+}
+
+/* the next block of the input: its length, 0 at the end, or -1 if the
+   input is corrupt or couldn't be read.  The block stays valid until the
+   next call. */
+
+ssize_t zr_next(ZREADER *z, const char **block)
+{
+  ssize_t len;
+
+  pthread_mutex_lock(&z->lock);
+  if (z->held)
+    {
+      z->head = (z->head + 1) % NZBLOCKS;
+      z->count--;
+      z->held = 0;
+      pthread_cond_signal(&z->emptied);
+    }
+  while (z->count == 0 && !z->ended)
+    pthread_cond_wait(&z->filled, &z->lock);
+  if (z->count == 0)
+    len = z->error ? -1 : 0;
+  else
+    {
+      z->held = 1;
+      *block = z->blocks[z->head];
+      len = z->lens[z->head];
+    }
+  pthread_mutex_unlock(&z->lock);
+  return len;
+}
+
+/* stop reading (fd is left open) */
+
+void zr_close(ZREADER *z)
+{
+  int i;
+
+  pthread_mutex_lock(&z->lock);
+  z->stop = 1;
+  pthread_cond_signal(&z->emptied);
+  pthread_mutex_unlock(&z->lock);
+  pthread_join(z->thread, NULL);
+  for (i = 0; i < NZBLOCKS; i++)
+    free(z->blocks[i]);
+  pthread_mutex_destroy(&z->lock);
+  pthread_cond_destroy(&z->filled);
+  pthread_cond_destroy(&z->emptied);
+  free(z);
+}
+
+
+/* ------------------------------- writing ------------------------------- */
+
+struct ZWRITER
+{
+  int format;
+  z_stream s;
+#ifdef HAVE_ZSTD
+  ZSTD_CStream *c;
+#endif
+};
+
+ZWRITER *zw_open(int format)
+{
+  ZWRITER *z = (ZWRITER *)calloc(1, sizeof(ZWRITER));
+
+  z->format = format;
+#ifdef HAVE_ZSTD
+  if (format == ZIO_ZSTD)
+    {
+      z->c = ZSTD_createCStream();
+      ZSTD_initCStream(z->c, 1);
+      return z;
+    }
+#endif
+  /* the fastest level: the stems compress well anyway, and the stemmer
+     shouldn't have to wait for the compressor */
+  deflateInit2(&z->s, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+  return z;
+}
+
+/* compress data[0..len), and if finish is set, end the stream.  *out is set
+   to a buffer (to be freed by the caller) with the compressed data, and its
+   length is returned. */
+
+size_t zw_compress(ZWRITER *z, const char *data, size_t len, int finish, char **out)
+{
+  size_t cap = len / 2 + 4096, got = 0;
+  char *buf = (char *)malloc(cap);
+
+#ifdef HAVE_ZSTD
+  if (z->format == ZIO_ZSTD)
+    {
+      ZSTD_inBuffer in = { data, len, 0 };
+      ZSTD_outBuffer o;
+      size_t r;
+
+      for (;;)
+        {
+          o.dst = buf;
+          o.size = cap;
+          o.pos = got;
+          r = ZSTD_compressStream2(z->c, &o, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+          got = o.pos;
+          if (in.pos == in.size && (!finish || r == 0) && o.pos < o.size)
+            break;
+          cap *= 2;
+          buf = (char *)realloc(buf, cap);
+        }
+      *out = buf;
+      return got;
+    }
+#endif
+  z->s.next_in = (Bytef *)data;
+  z->s.avail_in = len;
+  for (;;)
+    {
+      int ret;
+
+      z->s.next_out = (Bytef *)buf + got;
+      z->s.avail_out = cap - got;
+      ret = deflate(&z->s, finish ? Z_FINISH : Z_NO_FLUSH);
+      got = cap - z->s.avail_out;
+      if (z->s.avail_in == 0 && (!finish || ret == Z_STREAM_END) && z->s.avail_out > 0)
+        break;
+      cap *= 2;
+      buf = (char *)realloc(buf, cap);
+    }
+  *out = buf;
+  return got;
+}
+
+void zw_close(ZWRITER *z)
+{
+#ifdef HAVE_ZSTD
+  if (z->format == ZIO_ZSTD)
+    ZSTD_freeCStream(z->c);
+  else
+#endif
+    deflateEnd(&z->s);
+  free(z);
+}
+
+
+/* ---------------------------- stdio streams ---------------------------- */
+
+typedef struct
+{
+  ZREADER *z;
+  const char *block;
+  size_t len, pos;
+} ZINPUT;
+
+static ssize_t input_read(void *cookie, char *buf, size_t size)
+{
+  ZINPUT *in = (ZINPUT *)cookie;
+  ssize_t n;
+
+  while (in->pos == in->len)
+    {
+      if ((n = zr_next(in->z, &in->block)) < 0)
+        {
+          errno = EIO;
+          return -1;
+        }
+      if (n == 0)
+        return 0;
+      in->len = n;
+      in->pos = 0;
+    }
+  if (size > in->len - in->pos)
+    size = in->len - in->pos;
+  memcpy(buf, in->block + in->pos, size);
+  in->pos += size;
+  return size;
+}
+
+static int input_close(void *cookie)
+{
+  ZINPUT *in = (ZINPUT *)cookie;
+
+  zr_close(in->z);
+  free(in);
+  return 0;
+}
+
+/* f, decompressed if it is compressed (and read ahead on a thread if it is
+   a pipe).  Nothing may have been read from f yet.  Returns NULL if f is in
+   a format that wasn't built in. */
+
+FILE *zio_input(FILE *f)
+{
+  cookie_io_functions_t io = { input_read, NULL, NULL, input_close };
+  unsigned char magic[ZIO_MAGIC];
+  int fd = fileno(f), format;
+  struct stat st;
+  ssize_t n = 0, r;
+  off_t at;
+  ZINPUT *in;
+  FILE *z;
+
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (at = lseek(fd, 0, SEEK_CUR)) >= 0)
+    {
+      /* a file can be looked at without reading it */
+      n = pread(fd, magic, ZIO_MAGIC, at);
+      format = zio_format(magic, n < 0 ? 0 : n);
+      if (format == ZIO_NONE)
+        return f;
+      n = 0;
+    }
+  else
+    {
+      /* read only as far as it could still be compressed, so a line typed
+         at a terminal isn't held up */
+      while (n == 0 || (n < ZIO_MAGIC && magic_prefix(magic, n)))
+        {
+          r = read(fd, magic + n, 1);
+          if (r < 0 && errno == EINTR)
+            continue;
+          if (r <= 0)
+            break;
+          n += r;
+        }
+      format = zio_format(magic, n);
+    }
+  in = (ZINPUT *)calloc(1, sizeof(ZINPUT));
+  if ((in->z = zr_open(fd, format, magic, n)) == NULL)
+    {
+      free(in);
+      return NULL;
+    }
+  z = fopencookie(in, "r", io);
+  setvbuf(z, NULL, _IOFBF, ZBLOCK);
+  return z;
+}
+
+typedef struct
+{
+  ZWRITER *z;
+  FILE *f;
+} ZOUTPUT;
+
+static ssize_t output_write(void *cookie, const char *buf, size_t size)
+{
+  ZOUTPUT *out = (ZOUTPUT *)cookie;
+  char *data;
+  size_t n = zw_compress(out->z, buf, size, 0, &data);
+
+  if (fwrite(data, 1, n, out->f) != n)
+    size = 0;
+  free(data);
+  return size;
+}
+
+static int output_close(void *cookie)
+{
+  ZOUTPUT *out = (ZOUTPUT *)cookie;
+  char *data;
+  size_t n = zw_compress(out->z, NULL, 0, 1, &data);
+  int result = fwrite(data, 1, n, out->f) == n ? 0 : EOF;
+
+  free(data);
+  zw_close(out->z);
+  if (fflush(out->f) != 0)
+    result = EOF;
+  free(out);
+  return result;
+}
+
+/* a stream whose output is compressed into f; closing it ends the
+   compressed stream (f is flushed, not closed) */
+
+FILE *zio_output(FILE *f, int format)
+{
+  cookie_io_functions_t io = { NULL, output_write, NULL, output_close };
+  ZOUTPUT *out;
+  FILE *z;
+
+  if (format == ZIO_NONE)
+    return f;
+  out = (ZOUTPUT *)malloc(sizeof(ZOUTPUT));
+  out->z = zw_open(format);
+  out->f = f;
+  z = fopencookie(out, "w", io);
+  setvbuf(z, NULL, _IOFBF, ZBLOCK);
+  return z;
+}
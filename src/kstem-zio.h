@@ -0,0 +1,39 @@
+/*
+ * Compressed input and output, for kstem and kstem-file.
+ *
+ * Input is recognized by its first bytes: gzip (with zlib), or zstd when
+ * built with HAVE_ZSTD.  A ZREADER decompresses on a thread of its own,
+ * into a few blocks that are handed to the reader in turn, so the stemmer
+ * works on one block while the next is being decompressed.  Uncompressed
+ * input can be read the same way (ZIO_NONE), which just reads ahead.
+ *
+ * A ZWRITER compresses output a buffer at a time.
+ *
+ * zio_input() and zio_output() wrap these as stdio streams, for code that
+ * reads with fgets() or writes with fprintf().
+ */
+
+#define ZIO_NONE 0
+#define ZIO_GZIP 1
+#define ZIO_ZSTD 2
+
+#define ZIO_MAGIC 4      /* bytes needed to recognize a format */
+
+int zio_format(const void *magic, size_t len);
+int zio_format_named(const char *name);
+const char *zio_suffix(int format);
+
+typedef struct ZREADER ZREADER;
+
+ZREADER *zr_open(int fd, int format, const void *prefix, size_t prefix_len);
+ssize_t zr_next(ZREADER *z, const char **block);
+void zr_close(ZREADER *z);
+
+typedef struct ZWRITER ZWRITER;
+
+ZWRITER *zw_open(int format);
+size_t zw_compress(ZWRITER *z, const char *data, size_t len, int finish, char **out);
+void zw_close(ZWRITER *z);
+
+FILE *zio_input(FILE *f);
+FILE *zio_output(FILE *f, int format);
@@ -1,22 +1,332 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "kstem-proto.h"
+#include "kstem.h"
+#include "kstem-counts.h"
+#include "kstem-fields.h"
+#include "kstem-zio.h"
+#include "kstem-trace.h"
 #define MAXLINE 500000
-/* Function prototypes */
-void read_dict_info();
-void stem(char *, char *);
+#define MAXSTEM (MAXLINE+256) /* room for -ic -> -ical, or a long root from a direct conflation */
+#define MAXBATCH 8192   /* words sent to kstemd per request */
 
-int main () {
+/* the standard input, decompressed if need be, and the standard output,
+   compressed if asked for */
+static FILE *in, *out;
+
+/* --cache: a snapshot of the stem cache, read at the start and written at
+   the end, so one run starts where the last left off */
+#define DEFAULT_CACHE "65536"
+static const char *cache_path = NULL;
+
+/* --capture: a sample of the tokens, for bench-kstem -T to replay */
+static TRACE_WRITER *capture = NULL;
+
+/* send the pending words to kstemd and print the stems, one line of output
+   for each line of input.  The last line may still be open (it continues in
+   the next request), in which case its newline is not printed yet. */
+static void flush_batch(int fd, BATCH *b, int *line_words, int nlines, int open){
+	const char *s;
+	unsigned int len;
+	int i, n;
+	if (batch_send(fd, b)!=0 || batch_recv(fd, b)!=1){
+		fprintf(stderr,"kstem: lost the connection to kstemd\n");
+		exit(1);
+	}
+	if (b->count==KSTEM_ERROR_COUNT){
+		if (!batch_next(b,&s,&len))
+			len=0;
+		fprintf(stderr,"kstem: kstemd: %.*s\n",(int)len,len?s:"");
+		exit(1);
+	}
+	for (i=0;i<nlines;i++){
+		for (n=0;n<line_words[i] && batch_next(b,&s,&len);n++){
+			fwrite(s,1,len,out);
+			fputc(' ',out);
+		}
+		if (i<nlines-1 || !open)
+			fprintf(out,"\n");
+	}
+	batch_reset(b);
+}
+
+/* thin client: tokenize exactly as below, but let a kstemd process do the
+   stemming */
+static int run_client(const char *path, char *buffer){
+	struct sockaddr_un addr;
+	static int line_words[MAXBATCH+1];
+	int nlines=0;
+	BATCH b;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	memset(&addr,0,sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path,path,sizeof(addr.sun_path)-1);
+	if (fd<0 || connect(fd,(struct sockaddr *)&addr,sizeof(addr))<0){
+		fprintf(stderr,"kstem: couldn't connect to kstemd at %s\n",path);
+		return 1;
+	}
+	batch_init(&b);
+	while (fgets(buffer,MAXLINE,in)!=NULL){
+		char *w = NULL;
+		line_words[nlines]=0;
+		for (w=strtok(buffer,"\t\r\n\f\v ");w!=NULL;w=strtok(NULL,"\t\r\n\f\v ")){
+			if (strlen(w)>0){
+				if (b.count>=MAXBATCH || batch_add(&b,w,strlen(w))!=0){
+					flush_batch(fd,&b,line_words,nlines+1,1);
+					nlines=0;
+					line_words[0]=0;
+					if (batch_add(&b,w,strlen(w))!=0){
+						fprintf(stderr,"kstem: word too long for kstemd\n");
+						return 1;
+					}
+				}
+				line_words[nlines]++;
+			}
+		}
+		nlines++;
+		if (nlines>=MAXBATCH || b.count>=MAXBATCH){
+			flush_batch(fd,&b,line_words,nlines,0);
+			nlines=0;
+		}
+	}
+	if (nlines>0)
+		flush_batch(fd,&b,line_words,nlines,0);
+	batch_free(&b);
+	close(fd);
+	return 0;
+}
+
+/* --spans: for each token, the line it is on, where it starts in the line,
+   its length, and its stem.  The text format is one tab-separated record per
+   token; the binary one is, per token, the line, start, length and stem
+   length as 32-bit integers in network byte order, followed by the stem. */
+enum { SPANS_NONE, SPANS_TSV, SPANS_BINARY };
+enum { COUNTS_NONE, COUNTS_BY_FREQUENCY, COUNTS_BY_STEM };
+
+static unsigned long span_line;
+
+static void print_span_tsv(const KSTEM_SPAN *span, void *arg){
+	fprintf(out,"%lu\t%lu\t%lu\t%s\n",span_line,(unsigned long)span->start,
+	        (unsigned long)span->length,span->stem);
+}
+
+static void print_span_binary(const KSTEM_SPAN *span, void *arg){
+	uint32_t head[4];
+	head[0] = htonl(span_line);
+	head[1] = htonl(span->start);
+	head[2] = htonl(span->length);
+	head[3] = htonl(span->stem_length);
+	fwrite(head,sizeof(head),1,out);
+	fwrite(span->stem,1,span->stem_length,out);
+}
+
+/* the lines are read whole, however long, so the offsets are always
+   offsets into the line as it was given */
+static void run_spans(int format){
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	while ((len=getline(&line,&cap,in))>=0){
+		span_line++;
+		kstem_spans(line,len,format==SPANS_TSV ? print_span_tsv : print_span_binary,NULL);
+	}
+	free(line);
+}
+
+/* stem in here, rather than in kstemd */
+static int run_local(const char *overlay_dir, unsigned int profile, int spans, int counts, unsigned int top,
+                     int nthreads, int fields, const char *field_list, char *buffer){
+	LEXICON *overlay = NULL;
     read_dict_info();
-	char buffer[MAXLINE];
-	while (fgets(buffer,MAXLINE,stdin)!=NULL){
+	kstem_set_profile(profile);
+	if (cache_path!=NULL)
+		kstem_cache_load(cache_path);
+	if (overlay_dir!=NULL){
+		overlay = read_overlay_info(overlay_dir);
+		if (overlay==NULL)
+			exit(1);
+		kstem_set_overlay(overlay);
+	}
+	if (counts!=COUNTS_NONE)
+		return run_counts(in,out,nthreads,counts==COUNTS_BY_FREQUENCY,top,overlay,profile);
+	if (fields!=0)
+		return run_fields(in,out,fields,field_list);
+	if (spans!=SPANS_NONE){
+		run_spans(spans);
+		return 0;
+	}
+	while (fgets(buffer,MAXLINE,in)!=NULL){
 		char *w = NULL;
-		for (w=strtok(buffer,"\t\r\n ");w!=NULL;w=strtok(NULL,"\t\r\n ")){
+		for (w=strtok(buffer,"\t\r\n\f\v ");w!=NULL;w=strtok(NULL,"\t\r\n\f\v ")){
 			if (strlen(w)>0){
-			    char thestem[80];
+			    static char thestem[MAXSTEM];
+				if (capture!=NULL)
+					trace_token(capture,w,strlen(w));
 		        stem(w, thestem);
-				fprintf(stdout,"%s ",thestem);
+				fprintf(out,"%s ",thestem);
 			}
 		}
-		fprintf(stdout,"\n");
+		fprintf(out,"\n");
+	}
+	return 0;
+}
+
+static void usage(){
+	fprintf(stderr,"usage: kstem [-s kstemd-socket] [-o overlay-dir] [-z gzip|zstd] [--profile=profile] [--cache=snapshot]\n"
+	               "             [--capture=trace [--capture-rate=fraction]]\n"
+	               "             [--spans[=tsv|binary]]\n"
+	               "             [--counts[=freq|lex] [--top=K] [--threads=N]]\n"
+	               "                 (with --top, each count is a lower bound: the times the stem is certain to occur)\n"
+	               "             [--tsv=column,... | --json=name,...]\n");
+	exit(1);
+}
+
+int main (int argc, char *argv[]) {
+	static char buffer[MAXLINE];
+	const char *server = NULL;
+	const char *overlay_dir = NULL;
+	int spans = SPANS_NONE;
+	int counts = COUNTS_NONE;
+	unsigned int top = 0;
+	int fields = 0;
+	const char *field_list = NULL;
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int compress = ZIO_NONE;
+	int profile = KSTEM_FULL;
+	const char *capture_path = NULL;
+	double capture_rate = 1.0;
+	int c, status = 0;
+	static struct option options[] = {
+		{ "spans", optional_argument, NULL, 'p' },
+		{ "counts", optional_argument, NULL, 'c' },
+		{ "top", required_argument, NULL, 'k' },
+		{ "threads", required_argument, NULL, 'j' },
+		{ "tsv", required_argument, NULL, 't' },
+		{ "json", required_argument, NULL, 'J' },
+		{ "compress", required_argument, NULL, 'z' },
+		{ "profile", required_argument, NULL, 'P' },
+		{ "cache", required_argument, NULL, 'C' },
+		{ "capture", required_argument, NULL, 'W' },
+		{ "capture-rate", required_argument, NULL, 'R' },
+		{ NULL, 0, NULL, 0 } };
+	while ((c=getopt_long(argc,argv,"s:o:z:",options,NULL))!=-1){
+		switch (c){
+		case 's':
+			server = optarg;
+			break;
+		case 'o':
+			overlay_dir = optarg;
+			break;
+		case 'p':
+			if (optarg==NULL || strcmp(optarg,"tsv")==0)
+				spans = SPANS_TSV;
+			else if (strcmp(optarg,"binary")==0)
+				spans = SPANS_BINARY;
+			else
+				usage();
+			break;
+		case 'c':
+			if (optarg==NULL || strcmp(optarg,"freq")==0)
+				counts = COUNTS_BY_FREQUENCY;
+			else if (strcmp(optarg,"lex")==0)
+				counts = COUNTS_BY_STEM;
+			else
+				usage();
+			break;
+		case 'k':
+			top = atoi(optarg);
+			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			break;
+		case 't':
+		case 'J':
+			if (fields!=0)
+				usage();
+			fields = c=='t' ? FIELDS_TSV : FIELDS_JSON;
+			field_list = optarg;
+			break;
+		case 'z':
+			compress = zio_format_named(optarg);
+			if (compress<0){
+				fprintf(stderr,"kstem: can't compress with %s\n",optarg);
+				exit(1);
+			}
+			break;
+		case 'P':
+			profile = kstem_parse_profile(optarg);
+			if (profile<0){
+				fprintf(stderr,"kstem: unknown profile %s\n",optarg);
+				exit(1);
+			}
+			break;
+		case 'C':
+			cache_path = optarg;
+			setenv("KSTEM_CACHE",DEFAULT_CACHE,0);
+			break;
+		case 'W':
+			capture_path = optarg;
+			break;
+		case 'R':
+			capture_rate = atof(optarg);
+			if (capture_rate<=0 || capture_rate>1){
+				fprintf(stderr,"kstem: the capture rate must be more than 0 and at most 1\n");
+				exit(1);
+			}
+			break;
+		default:
+			usage();
+		}
+	}
+	if (server!=NULL && profile!=KSTEM_FULL){
+		fprintf(stderr,"kstem: the profile of kstemd is set when it is started (kstemd -p)\n");
+		exit(1);
+	}
+	if (server!=NULL && (spans!=SPANS_NONE || counts!=COUNTS_NONE || fields!=0)){
+		fprintf(stderr,"kstem: --spans, --counts, --tsv and --json can't be used with kstemd (-s)\n");
+		exit(1);
+	}
+	if ((spans!=SPANS_NONE) + (counts!=COUNTS_NONE) + (fields!=0) > 1)
+		usage();
+	if (capture_path!=NULL && (server!=NULL || spans!=SPANS_NONE || counts!=COUNTS_NONE || fields!=0)){
+		fprintf(stderr,"kstem: --capture only samples the words of plain text stemmed here (not with -s, --spans, --counts, --tsv or --json)\n");
+		exit(1);
+	}
+	if (capture_path!=NULL && (capture = trace_create(capture_path,capture_rate))==NULL){
+		fprintf(stderr,"kstem: couldn't write the trace %s\n",capture_path);
+		exit(1);
+	}
+	in = zio_input(stdin);
+	if (in==NULL){
+		fprintf(stderr,"kstem: the input is compressed with zstd, which this kstem was built without\n");
+		exit(1);
+	}
+	out = zio_output(stdout,compress);
+	if (server!=NULL)
+		status = run_client(server,buffer);
+	else
+		status = run_local(overlay_dir,profile,spans,counts,top,nthreads,fields,field_list,buffer);
+	if (server==NULL && cache_path!=NULL && kstem_cache_save(cache_path)<0){
+		fprintf(stderr,"kstem: couldn't save the stem cache in %s\n",cache_path);
+		status = 1;
+	}
+	if (capture!=NULL && trace_close(capture)!=0){
+		fprintf(stderr,"kstem: couldn't write the trace %s\n",capture_path);
+		status = 1;
+	}
+	if (ferror(in)){
+		fprintf(stderr,"kstem: the input is corrupt or couldn't be read\n");
+		status = 1;
+	}
+	if (out!=stdout && fclose(out)!=0){
+		fprintf(stderr,"kstem: couldn't write the output\n");
+		status = 1;
 	}
+	return status;
 }
@@ -0,0 +1,145 @@
+/*
+ * kstem.h - the public interface of the Kstem library (libkstem.a and
+ *           libkstem.so).  See kstem-doc.txt for a description of the
+ *           stemmer and the lexicon files it needs.
+ */
+
+#ifndef KSTEM_H
+#define KSTEM_H
+
+#if defined(__GNUC__)
+#define KSTEM_API __attribute__((visibility("default")))
+#else
+#define KSTEM_API
+#endif
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct lexicon LEXICON;      /* a set of words, such as an overlay */
+
+
+/* load the lexicon files in $STEM_DIR.  Must be called before stem(). */
+KSTEM_API void read_dict_info();
+
+/* reduce term to its stem.  The caller provides the storage for the stem,
+   which can be two characters longer than term, or as long as the longest
+   root form in the direct-conflation files. */
+KSTEM_API void stem(char *term, char *stem);
+
+/* the storage stem() needs for a term of len characters (including the '\0') */
+KSTEM_API size_t kstem_stem_size(size_t len);
+
+/* check the lexicon files in $STEM_DIR, and write the dictionary to image
+   (if not NULL) for read_dict_info() to map; returns the number of problems */
+KSTEM_API int kstem_check_lexicon(const char *image);
+
+
+/* Profiles: which families of derivational endings stem() removes, for
+   the calling thread.  The inflectional endings (plurals, past tenses and
+   -ing) are always removed.  Each of the full and inflectional profiles is
+   a separately compiled stemmer, so the inflectional one is cheaper. */
+
+#define KSTEM_ITY   0x0001
+#define KSTEM_NESS  0x0002
+#define KSTEM_ION   0x0004
+#define KSTEM_ER    0x0008        /* -er and -or */
+#define KSTEM_LY    0x0010
+#define KSTEM_AL    0x0020
+#define KSTEM_IVE   0x0040
+#define KSTEM_IZE   0x0080
+#define KSTEM_MENT  0x0100
+#define KSTEM_BLE   0x0200
+#define KSTEM_ISM   0x0400
+#define KSTEM_IC    0x0800
+#define KSTEM_NCY   0x1000
+#define KSTEM_NCE   0x2000
+#define KSTEM_INFLECTIONAL 0
+#define KSTEM_FULL  0x3fff
+
+KSTEM_API int kstem_set_profile(unsigned int families);
+KSTEM_API int kstem_parse_profile(const char *spec);
+
+
+/* Spans: the tokens of a buffer (separated by white space -- spaces, tabs,
+   carriage returns, newlines, form feeds and vertical tabs, as kstem
+   separates them), each with where it is in the buffer and its stem.  The
+   buffer is not copied or modified. */
+
+typedef struct
+{
+   size_t start;             /* offset of the token in the buffer */
+   size_t length;            /* length of the token */
+   const char *stem;         /* its stem, '\0'-terminated; valid until the callback returns */
+   size_t stem_length;
+   const char *text;         /* the token itself (not '\0'-terminated); valid as long as stem */
+} KSTEM_SPAN;
+
+typedef void (*KSTEM_SPAN_FN)(const KSTEM_SPAN *span, void *arg);
+
+/* call fn for each token of text[0..len), in order; returns the number of tokens */
+KSTEM_API size_t kstem_spans(const char *text, size_t len, KSTEM_SPAN_FN fn, void *arg);
+
+/* Streams: the same, for text that arrives in pieces of any size (from a
+   socket, or a file read a block at a time).  A token split between pieces
+   is put back together, and the offsets count from the start of the
+   stream.  A stream keeps its buffers from piece to piece, so once it has
+   seen its longest token it allocates nothing.  One thread at a time may
+   use a stream.  kstem-analyzer.h wraps these for C++. */
+
+typedef struct kstem_stream KSTEM_STREAM;
+
+KSTEM_API KSTEM_STREAM *kstem_stream_new();
+KSTEM_API void kstem_stream_free(KSTEM_STREAM *s);
+
+/* take the next piece, which must stay put until kstem_stream_next()
+   returns 0; data NULL marks the end of the stream */
+KSTEM_API void kstem_stream_write(KSTEM_STREAM *s, const char *data, size_t len);
+
+/* the next token of the stream that is complete so far, in span (the stem
+   and text are valid until the next call); returns 0 when the piece is used
+   up.  At the end of the stream, the stream is then ready for another. */
+KSTEM_API int kstem_stream_next(KSTEM_STREAM *s, KSTEM_SPAN *span);
+
+
+/* Overlays: small per-tenant additions searched before the dictionary */
+
+KSTEM_API LEXICON *read_overlay_info(const char *dir);
+KSTEM_API void kstem_set_overlay(LEXICON *lex);
+
+
+/* Changes to the dictionary while stemmers are running */
+
+KSTEM_API int kstem_add_word(const char *w);
+KSTEM_API int kstem_add_conflation(const char *variant, const char *root);
+KSTEM_API int kstem_remove(const char *w);
+KSTEM_API unsigned long kstem_dictionary_generation();
+
+
+
+/* The stem cache (KSTEM_CACHE): what it has done so far, and snapshots of
+   it for a warm start */
+
+typedef struct
+{
+   unsigned long entries;        /* the size of the cache */
+   unsigned long hits;
+   unsigned long misses;
+   unsigned long snapshot_hits;  /* misses found in the snapshot */
+   unsigned long raced_reads;    /* lookups that met an entry being written */
+   unsigned long locked_out;     /* stems not kept, because another thread was writing */
+   unsigned long evictions;
+} KSTEM_CACHE_STATS;
+
+KSTEM_API void kstem_cache_stats(KSTEM_CACHE_STATS *stats);
+KSTEM_API int kstem_cache_save(const char *path);
+KSTEM_API int kstem_cache_load(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,266 @@
+/*
+   kstemd - a resident stemming daemon.
+
+   The lexicon is loaded once, and stemming requests are then served over a
+   Unix domain socket by a pool of worker threads, so the cost of
+   read_dict_info() is paid once rather than by every process that needs
+   stems.  The protocol is described in kstem-proto.h; `kstem -s' is the
+   matching client.
+
+   The workers don't each hold a connection: every connection waits in one
+   epoll set, and a worker takes a single request from whichever has one
+   ready, answers it, and puts the connection back.  So any number of
+   clients can stay connected, idle or not, and -w only bounds how many
+   requests are stemmed at once.  A client that stops in the middle of a
+   request is dropped after IO_TIMEOUT seconds.
+
+   usage:  kstemd [-s socket] [-w workers] [-o overlay-dir] [-p profile]
+                  [-c cache-snapshot]
+
+   With -o, the words in overlay-dir (see read_overlay_info()) are consulted
+   before the dictionary.  With -p, the workers stem with the given profile
+   (see kstem_parse_profile()): "inflectional", "full", or a list of the
+   families of derivational endings to remove.
+
+   With -c, the stems cached while serving (see kstem_cache_save()) are
+   written to cache-snapshot when kstemd is stopped (with SIGINT or
+   SIGTERM), and read back from it when it starts again, so a restarted
+   kstemd doesn't begin cold.  The workers share a cache of KSTEM_CACHE
+   stems (DEFAULT_CACHE if that isn't set).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "kstem-proto.h"
+#include "kstem.h"
+
+#define DEFAULT_WORKERS 4
+#define MAX_WORKERS 256
+#define DEFAULT_CACHE "65536"
+#define IO_TIMEOUT 10             /* seconds a request or a reply may take to arrive */
+
+
+static const char *socket_path = KSTEM_SOCKET_DEFAULT;
+static int listen_fd = -1;
+static int epoll_fd = -1;                  /* the listening socket and the idle connections */
+static LEXICON *overlay = NULL;
+static unsigned int profile = KSTEM_FULL;
+
+
+/* stem every word of a request and send back the reply, or an error reply
+   if the stems don't fit in one */
+
+static int serve_batch(int fd, BATCH *req, BATCH *reply, char *term, char **thestem, size_t *stem_size)
+{
+   const char *w;
+   unsigned int len;
+   size_t need, n;
+
+   batch_reset(reply);
+   while (batch_next(req, &w, &len))  {
+      need = kstem_stem_size(len);
+      if (need > *stem_size)  {
+         *stem_size = need * 2;
+         *thestem = (char *)realloc(*thestem, *stem_size);
+         }
+      memcpy(term, w, len);
+      term[len] = '\0';
+      stem(term, *thestem);
+      n = strlen(*thestem);
+      if (batch_add(reply, *thestem, n) != 0)  {
+         batch_error(reply, n > KSTEM_MAX_TOKEN ? "a stem is longer than a reply can carry"
+                                                : "the stems are too long for one reply; send fewer words at a time");
+         break;
+         }
+      }
+   return batch_send(fd, reply);
+}
+
+
+/* put fd (back) in the epoll set, to be handed to one worker the next time
+   it is readable */
+
+static int watch(int fd, int op)
+{
+   struct epoll_event ev;
+
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN | EPOLLONESHOT;
+   ev.data.fd = fd;
+   return epoll_ctl(epoll_fd, op, fd, &ev);
+}
+
+/* take in the waiting connections; the listening socket is non-blocking */
+
+static void accept_clients()
+{
+   struct timeval timeout;
+   int fd;
+
+   timeout.tv_sec = IO_TIMEOUT;
+   timeout.tv_usec = 0;
+   while ((fd = accept(listen_fd, NULL, NULL)) >= 0)  {
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      if (watch(fd, EPOLL_CTL_ADD) != 0)  {
+         perror("kstemd: epoll_ctl");
+         close(fd);
+         }
+      }
+   if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+      perror("kstemd: accept");
+   watch(listen_fd, EPOLL_CTL_MOD);
+}
+
+/* each worker waits for a connection with a request ready (or a new one),
+   serves that one request, and hands the connection back */
+
+static void *worker(void *arg)
+{
+   struct epoll_event ev;
+   BATCH req, reply;
+   char *term, *thestem = NULL;
+   size_t stem_size = 0;
+   int fd, n, r;
+
+   kstem_set_overlay(overlay);
+   kstem_set_profile(profile);
+   batch_init(&req);
+   batch_init(&reply);
+   term = (char *)malloc(KSTEM_MAX_TOKEN + 1);
+
+   for (;;)  {
+      n = epoll_wait(epoll_fd, &ev, 1, -1);
+      if (n < 0)  {
+         if (errno == EINTR)
+            continue;
+         perror("kstemd: epoll_wait");
+         break;
+         }
+      fd = ev.data.fd;
+      if (fd == listen_fd)  {
+         accept_clients();
+         continue;
+         }
+      r = batch_recv(fd, &req);
+      if (r == 1 && serve_batch(fd, &req, &reply, term, &thestem, &stem_size) == 0 && watch(fd, EPOLL_CTL_MOD) == 0)
+         continue;
+      if (r < 0)
+         fprintf(stderr, errno == EAGAIN || errno == EWOULDBLOCK
+                         ? "kstemd: dropping a client that stalled in the middle of a request\n"
+                         : "kstemd: dropping a client after a malformed request\n");
+      close(fd);
+      }
+
+   free(term);
+   free(thestem);
+   batch_free(&req);
+   batch_free(&reply);
+   return NULL;
+}
+
+
+int main (int argc, char *argv[]) {
+
+   struct sockaddr_un addr;
+   pthread_t threads[MAX_WORKERS];
+   int workers = DEFAULT_WORKERS;
+   const char *overlay_dir = NULL, *cache_path = NULL;
+   sigset_t stop;
+   int i, c, sig;
+
+   while ((c = getopt(argc, argv, "s:w:o:p:c:")) != -1)  {
+      switch (c)  {
+         case 's':
+            socket_path = optarg;
+            break;
+         case 'w':
+            workers = atoi(optarg);
+            break;
+         case 'o':
+            overlay_dir = optarg;
+            break;
+         case 'p':
+            if ((i = kstem_parse_profile(optarg)) < 0)  {
+               fprintf(stderr, "kstemd: unknown profile %s\n", optarg);
+               exit(1);
+               }
+            profile = i;
+            break;
+         case 'c':
+            cache_path = optarg;
+            break;
+         default:
+            fprintf(stderr, "usage: kstemd [-s socket] [-w workers] [-o overlay-dir] [-p profile]\n"
+                            "              [-c cache-snapshot]\n");
+            exit(1);
+         }
+      }
+   if (workers < 1 || workers > MAX_WORKERS)  {
+      fprintf(stderr, "kstemd: the number of workers must be between 1 and %d\n", MAX_WORKERS);
+      exit(1);
+      }
+   if (strlen(socket_path) >= sizeof(addr.sun_path))  {
+      fprintf(stderr, "kstemd: the socket path is too long\n");
+      exit(1);
+      }
+
+   /* load the lexicon before accepting anyone */
+   if (cache_path)
+      setenv("KSTEM_CACHE", DEFAULT_CACHE, 0);
+   read_dict_info();
+   if (cache_path)
+      kstem_cache_load(cache_path);      /* there may not be one yet */
+   if (overlay_dir)  {
+      overlay = read_overlay_info(overlay_dir);
+      if (!overlay)
+         exit(1);
+      }
+
+   listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (listen_fd < 0)  {
+      perror("kstemd: socket");
+      exit(1);
+      }
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, socket_path);
+   unlink(socket_path);
+   if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 128) < 0)  {
+      perror("kstemd: bind");
+      exit(1);
+      }
+   fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+   epoll_fd = epoll_create1(0);
+   if (epoll_fd < 0 || watch(listen_fd, EPOLL_CTL_ADD) != 0)  {
+      perror("kstemd: epoll");
+      exit(1);
+      }
+
+   /* the workers leave SIGINT and SIGTERM to this thread, which shuts down
+      in peace: saving the cache isn't something a signal handler can do */
+   signal(SIGPIPE, SIG_IGN);
+   sigemptyset(&stop);
+   sigaddset(&stop, SIGINT);
+   sigaddset(&stop, SIGTERM);
+   pthread_sigmask(SIG_BLOCK, &stop, NULL);
+
+   for (i = 0; i < workers; i++)
+      pthread_create(&threads[i], NULL, worker, NULL);
+   sigwait(&stop, &sig);
+
+   if (cache_path && kstem_cache_save(cache_path) < 0)
+      fprintf(stderr, "kstemd: couldn't save the stem cache in %s\n", cache_path);
+   unlink(socket_path);
+   return 0;
+}
@@ -0,0 +1,675 @@
+/*
+ * Offset-based dictionary images, and sharing them between processes
+ * through POSIX shared memory (see lexicon.h).
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "lexicon.h"
+
+#define ATTACH_WAIT_MS 10000     /* how long to wait for another process to finish an image */
+#define HUGE_PAGE (2*1024*1024)  /* the size of a (transparent) huge page */
+#define MPOL_PREFERRED 1         /* from <numaif.h>, which needs libnuma */
+#define MAX_NODES 1024
+
+
+/* the lexicon files, in the order read_dict_info() reads them */
+static const char *lexicon_files[] = {
+   "head_word_list.txt", "dict_supplement.txt", "e_exception_words.txt",
+   "direct_conflations.txt", "country_nationality.txt", "proper_nouns.txt", NULL };
+
+
+/*
+ * FNV-1a hash of a string
+ */
+
+unsigned int lex_hash(const char *key)
+{
+  unsigned int h = 2166136261u;
+
+  while (*key)
+    {
+      h ^= (unsigned char)*key++;
+      h *= 16777619u;
+    }
+  return h;
+}
+
+
+/*
+ * Search the lexicon for a key
+ */
+
+const LEXSLOT *lex_find(const LEXICON *lex, const char *key)
+{
+  unsigned int h, i, mask;
+  const LEXSLOT *s;
+
+  h = lex_hash(key);
+  mask = lex->nslots - 1;
+  for (i = h & mask; ; i = (i + 1) & mask)
+    {
+      s = &lex->slots[i];
+      if (s->key == 0)
+	return NULL;
+      if (s->hash == h && strcmp(lex->pool + s->key, key) == 0)
+	return s;
+    }
+}
+
+
+static void grow_pool(LEXICON *lex, size_t len);
+
+static unsigned int pool_add(LEXICON *lex, const char *str)
+{
+  unsigned int off;
+  size_t len;
+
+  if (*str == '\0')
+    return 0;
+  len = strlen(str) + 1;
+  grow_pool(lex, len);
+  off = lex->pool_size;
+  memcpy(lex->pool + off, str, len);
+  lex->pool_size += len;
+  return off;
+}
+
+
+/*
+ * Create an empty lexicon.  nwords and pool_bytes (the bytes taken by the
+ * words and roots, each with its '\0') are only hints; the lexicon grows as
+ * words are added.
+ */
+
+LEXICON *lex_create(unsigned int nwords, unsigned int pool_bytes)
+{
+  LEXICON *lex;
+
+  lex = (LEXICON *)calloc(1, sizeof(LEXICON));
+  lex->nslots = 16;
+  while (lex->nslots < 2 * nwords)
+    lex->nslots *= 2;
+  lex->slots = (LEXSLOT *)calloc(lex->nslots, sizeof(LEXSLOT));
+  lex->pool_cap = pool_bytes + 1;
+  lex->pool = (char *)malloc(lex->pool_cap);
+  lex->pool[0] = '\0';
+  lex->pool_size = 1;
+  return lex;
+}
+
+
+/*
+ * Double the number of slots, and put every entry back into the new table.
+ * The stored hashes mean no string is looked at.
+ */
+
+static void grow_slots(LEXICON *lex)
+{
+  LEXSLOT *old = lex->slots;
+  unsigned int n = lex->nslots, i, k, mask;
+
+  lex->nslots = 2 * n;
+  lex->slots = (LEXSLOT *)calloc(lex->nslots, sizeof(LEXSLOT));
+  mask = lex->nslots - 1;
+  for (i = 0; i < n; i++)
+    if (old[i].key != 0)
+      {
+	for (k = old[i].hash & mask; lex->slots[k].key != 0; k = (k + 1) & mask)
+	  ;
+	lex->slots[k] = old[i];
+      }
+  free(old);
+}
+
+
+/*
+ * Make room for len more bytes in the string pool.  Words are referred to
+ * by offset, so the pool can move.
+ */
+
+static void grow_pool(LEXICON *lex, size_t len)
+{
+  size_t cap = lex->pool_cap;
+
+  if (lex->pool_size + len <= cap)
+    return;
+  while (cap < lex->pool_size + len)
+    cap = cap < 4096 ? 4096 : 2 * cap;
+  if (cap > 0xffffffffu)
+    cap = 0xffffffffu;
+  if (lex->pool_size + len > cap)
+    {
+      fprintf(stderr, "Error!  The lexicon is larger than 4GB.\n");
+      exit(1);
+    }
+  lex->pool = (char *)realloc(lex->pool, cap);
+  lex->pool_cap = cap;
+}
+
+
+/*
+ * Add a word to a lexicon.  A word that is already present keeps its first
+ * entry; returns 0 in that case and 1 otherwise.  The empty word can't be
+ * added (its key would be offset 0, which marks an empty slot), and also
+ * gives 0.
+ */
+
+int lex_add(LEXICON *lex, const char *key, const char *root, unsigned int flags)
+{
+  unsigned int h, i, mask;
+  LEXSLOT *s;
+
+  if (key[0] == '\0')
+    return 0;
+  h = lex_hash(key);
+  mask = lex->nslots - 1;
+  for (i = h & mask; lex->slots[i].key != 0; i = (i + 1) & mask)
+    if (lex->slots[i].hash == h && strcmp(lex->pool + lex->slots[i].key, key) == 0)
+      return 0;
+
+  /* keep the table at most 3/4 full, so probe sequences stay short */
+  if (4 * (lex->nentries + 1) > 3 * lex->nslots)
+    {
+      grow_slots(lex);
+      mask = lex->nslots - 1;
+      for (i = h & mask; lex->slots[i].key != 0; i = (i + 1) & mask)
+	;
+    }
+  s = &lex->slots[i];
+  s->hash = h;
+  s->key = pool_add(lex, key);
+  s->root = pool_add(lex, root);
+  s->flags = flags;
+  lex->nentries++;
+  return 1;
+}
+
+
+/*
+ * Add flags to a word already in the lexicon.  Returns 0 if it isn't there.
+ */
+
+int lex_set_flags(LEXICON *lex, const char *key, unsigned int flags)
+{
+  LEXSLOT *s = (LEXSLOT *)lex_find(lex, key);
+
+  if (s == NULL)
+    return 0;
+  s->flags |= flags;
+  return 1;
+}
+
+
+/*
+ * Free a lexicon, whether it was built here or attached
+ */
+
+void lex_free(LEXICON *lex)
+{
+  if (lex->mapping)
+    munmap(lex->mapping, lex->mapping_size);
+  else
+    {
+      free(lex->slots);
+      free(lex->pool);
+    }
+  free(lex);
+}
+
+
+/*
+ * Summarize the lexicon files (their sizes, and their modification and
+ * change times to the nanosecond) so a shared segment built from other
+ * files can be recognized as stale.  The change time can't be set back by
+ * hand, so a file edited and then touched back to its old time still
+ * counts as changed.  This costs a stat() of each file, and a segment only
+ * lives as long as the machine is up, so it never sees a copied tree.
+ */
+
+static unsigned int files_stamp(const char *stemdir, unsigned int h)
+{
+  char path[4096];
+  struct stat st;
+  int i;
+
+  for (i = 0; lexicon_files[i] != NULL; i++)
+    {
+      snprintf(path, sizeof(path), "%s/%s", stemdir, lexicon_files[i]);
+      if (stat(path, &st) != 0)
+	continue;
+      h = (h ^ (unsigned int)st.st_size) * 16777619u;
+      h = (h ^ (unsigned int)st.st_mtim.tv_sec) * 16777619u;
+      h = (h ^ (unsigned int)st.st_mtim.tv_nsec) * 16777619u;
+      h = (h ^ (unsigned int)st.st_ctim.tv_sec) * 16777619u;
+      h = (h ^ (unsigned int)st.st_ctim.tv_nsec) * 16777619u;
+    }
+  return h;
+}
+
+unsigned int lex_stamp(const char *stemdir)
+{
+  return files_stamp(stemdir, lex_hash(stemdir));
+}
+
+/* the stamp of an image kept in the directory itself (see kstem-check.c),
+   which goes wherever the files go -- renamed, mounted elsewhere, copied by
+   an install or into a container -- and gets new times on the way.  So it
+   is taken from the files' contents (lex_checksum()), and differs from the
+   checksum itself, which tags a snapshot of the stem cache. */
+
+unsigned int lex_image_stamp(const char *stemdir)
+{
+  return (lex_checksum(stemdir) ^ LEX_MAGIC) * 16777619u;
+}
+
+
+/* whether a mapped image of size bytes holds together: its parts add up to
+   the size, every offset in the table is inside the pool, whose strings are
+   all terminated, no root is longer than the header says, and the table
+   has an empty slot to end a search.  A truncated or corrupt image would
+   otherwise crash the process that used it. */
+
+static int image_intact(const LEXHEADER *hdr, size_t size)
+{
+  const LEXSLOT *slots = (const LEXSLOT *)(hdr + 1);
+  const char *pool;
+  unsigned int i, used = 0;
+  size_t room;
+
+  if (size < sizeof(LEXHEADER) || hdr->nslots == 0 || (hdr->nslots & (hdr->nslots - 1)) != 0
+      || size != sizeof(LEXHEADER) + sizeof(LEXSLOT) * (size_t)hdr->nslots + hdr->pool_size
+      || hdr->pool_size == 0)
+    return 0;
+  pool = (const char *)(slots + hdr->nslots);
+  if (pool[0] != '\0' || pool[hdr->pool_size - 1] != '\0')
+    return 0;
+  for (i = 0; i < hdr->nslots; i++)
+    {
+      if (slots[i].key == 0)
+	continue;
+      used++;
+      if (slots[i].key >= hdr->pool_size || slots[i].root >= hdr->pool_size)
+	return 0;
+      room = hdr->pool_size - slots[i].root;
+      if (hdr->longest_root != 0 && slots[i].root != 0
+	  && memchr(pool + slots[i].root, '\0', room < hdr->longest_root + 1 ? room : hdr->longest_root + 1) == NULL)
+	return 0;
+    }
+  return used < hdr->nslots;
+}
+
+static LEXICON *view(void *mapping, size_t size)
+{
+  LEXHEADER *hdr = (LEXHEADER *)mapping;
+  LEXICON *lex;
+
+  lex = (LEXICON *)calloc(1, sizeof(LEXICON));
+  lex->nslots = hdr->nslots;
+  lex->nentries = hdr->nentries;
+  lex->slots = (LEXSLOT *)(hdr + 1);
+  lex->pool = (char *)(lex->slots + hdr->nslots);
+  lex->pool_size = hdr->pool_size;
+  lex->mapping = mapping;
+  lex->mapping_size = size;
+  lex->longest_root = hdr->longest_root;
+  return lex;
+}
+
+/* recorded in the header, so whoever maps the image needn't look at every
+   root to find it */
+
+static unsigned int longest_root(const LEXICON *lex)
+{
+  unsigned int i, len, longest = 0;
+
+  for (i = 0; i < lex->nslots; i++)
+    if (lex->slots[i].key != 0 && lex->slots[i].root != 0
+	&& (len = strlen(lex->pool + lex->slots[i].root)) > longest)
+      longest = len;
+  return longest;
+}
+
+
+/* whether the process that started writing an image has gone away without
+   finishing it */
+
+static int publisher_died(const LEXHEADER *hdr)
+{
+  pid_t pid = (pid_t)__atomic_load_n(&hdr->publisher, __ATOMIC_ACQUIRE);
+
+  return pid > 0 && kill(pid, 0) != 0 && errno == ESRCH;
+}
+
+
+/*
+ * Map an existing shared image read-only.  Returns NULL if there is no such
+ * segment, or if it was built from different lexicon files, or if it was
+ * never finished (its publisher died, or didn't finish in ATTACH_WAIT_MS).
+ * In those cases the name is unlinked, so a fresh image can be published
+ * under it; processes still using the old image keep their mapping.
+ */
+
+LEXICON *lex_shm_attach(const char *name, unsigned int stamp)
+{
+  LEXHEADER *hdr;
+  struct stat st;
+  void *mapping;
+  int fd, waited;
+
+  fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+    return NULL;
+
+  /* the publisher sizes the segment before writing it (one that has been
+     empty for longer than we would wait was abandoned) */
+  for (waited = 0; fstat(fd, &st) == 0 && (size_t)st.st_size < sizeof(LEXHEADER); waited++)
+    {
+      if (waited >= ATTACH_WAIT_MS || time(NULL) - st.st_mtime > ATTACH_WAIT_MS / 1000)
+	{
+	  close(fd);
+	  shm_unlink(name);
+	  return NULL;
+	}
+      usleep(1000);
+    }
+  mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return NULL;
+
+  hdr = (LEXHEADER *)mapping;
+  for (waited = 0; !__atomic_load_n(&hdr->ready, __ATOMIC_ACQUIRE); waited++)
+    {
+      if (waited >= ATTACH_WAIT_MS || publisher_died(hdr))
+	{
+	  munmap(mapping, st.st_size);
+	  shm_unlink(name);
+	  return NULL;
+	}
+      usleep(1000);
+    }
+
+  if (hdr->magic != LEX_MAGIC || hdr->version != LEX_VERSION || hdr->stamp != stamp
+      || !image_intact(hdr, st.st_size))
+    {
+      munmap(mapping, st.st_size);
+      shm_unlink(name);
+      return NULL;
+    }
+  return view(mapping, st.st_size);
+}
+
+
+/*
+ * Copy a lexicon into a new shared segment and return a read-only view of
+ * it.  If another process is publishing under the same name at the same
+ * time, its image is used instead.  A segment left unfinished by a process
+ * that died is removed by lex_shm_attach(), and the image published anew.
+ */
+
+LEXICON *lex_shm_publish(const char *name, const LEXICON *lex, unsigned int stamp)
+{
+  LEXICON *other;
+  LEXHEADER *hdr;
+  size_t size;
+  void *mapping;
+  int fd, tries;
+
+  for (tries = 0; ; tries++)
+    {
+      fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+      if (fd >= 0)
+	break;
+      if (errno != EEXIST)
+	return NULL;
+      if ((other = lex_shm_attach(name, stamp)) != NULL || tries > 0)
+	return other;
+    }
+
+  size = sizeof(LEXHEADER) + sizeof(LEXSLOT) * lex->nslots + lex->pool_size;
+  if (ftruncate(fd, size) != 0)
+    {
+      close(fd);
+      shm_unlink(name);
+      return NULL;
+    }
+  mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    {
+      shm_unlink(name);
+      return NULL;
+    }
+
+  hdr = (LEXHEADER *)mapping;
+  __atomic_store_n(&hdr->publisher, (unsigned int)getpid(), __ATOMIC_RELEASE);
+  hdr->magic = LEX_MAGIC;
+  hdr->version = LEX_VERSION;
+  hdr->stamp = stamp;
+  hdr->nslots = lex->nslots;
+  hdr->nentries = lex->nentries;
+  hdr->pool_size = lex->pool_size;
+  hdr->longest_root = longest_root(lex);
+  memcpy(hdr + 1, lex->slots, sizeof(LEXSLOT) * lex->nslots);
+  memcpy((char *)(hdr + 1) + sizeof(LEXSLOT) * lex->nslots, lex->pool, lex->pool_size);
+  __atomic_store_n(&hdr->ready, 1, __ATOMIC_RELEASE);
+
+  mprotect(mapping, size, PROT_READ);
+  return view(mapping, size);
+}
+
+
+/*
+ * Prefer NUMA node `node' for the pages of [addr, addr+len) that haven't
+ * been touched yet.  (The raw system call, so libnuma isn't needed.)
+ */
+
+static void prefer_node(void *addr, size_t len, int node)
+{
+#if defined(__linux__) && defined(__NR_mbind)
+  unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))];
+
+  if (node < 0 || node >= MAX_NODES)
+    return;
+  memset(mask, 0, sizeof(mask));
+  mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+  syscall(__NR_mbind, addr, len, MPOL_PREFERRED, mask, MAX_NODES + 1, 0);
+#endif
+}
+
+/* anonymous memory aligned to a huge page, so all of it can be huge pages */
+
+static void *map_aligned(size_t size)
+{
+  char *p, *start;
+
+  p = (char *)mmap(NULL, size + HUGE_PAGE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return MAP_FAILED;
+  start = (char *)(((unsigned long)p + HUGE_PAGE - 1) & ~(unsigned long)(HUGE_PAGE - 1));
+  if (start > p)
+    munmap(p, start - p);
+  munmap(start + size, p + HUGE_PAGE - start);
+  return start;
+}
+
+/*
+ * A checksum of the contents of the lexicon files.  Unlike lex_stamp(),
+ * it doesn't change when the files are merely copied or touched, so it can
+ * tag something kept on disk (a snapshot of the stem cache) for as long as
+ * the lexicon really is the same.
+ */
+
+unsigned int lex_checksum(const char *stemdir)
+{
+  char path[4096], buf[65536];
+  unsigned int h = 2166136261u;
+  ssize_t n, i;
+  int f, fd;
+
+  for (f = 0; lexicon_files[f] != NULL; f++)
+    {
+      snprintf(path, sizeof(path), "%s/%s", stemdir, lexicon_files[f]);
+      h = (h ^ (unsigned int)f) * 16777619u;
+      if ((fd = open(path, O_RDONLY)) < 0)
+	continue;
+      while ((n = read(fd, buf, sizeof(buf))) > 0)
+	for (i = 0; i < n; i++)
+	  h = (h ^ (unsigned char)buf[i]) * 16777619u;
+      close(fd);
+    }
+  return h;
+}
+
+
+/*
+ * Write a lexicon to a file as an image (the same layout as a shared
+ * segment), tagged with stamp.  The image is written under a temporary name
+ * and renamed, so a reader never sees a partial one.  Returns 0, or -1 if
+ * it couldn't be written.
+ */
+
+int lex_file_save(const char *path, const LEXICON *lex, unsigned int stamp)
+{
+  char tmp[4096];
+  LEXHEADER hdr;
+  FILE *f;
+  int ok;
+
+  snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+  if ((f = fopen(tmp, "wb")) == NULL)
+    return -1;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = LEX_MAGIC;
+  hdr.version = LEX_VERSION;
+  hdr.ready = 1;
+  hdr.stamp = stamp;
+  hdr.nslots = lex->nslots;
+  hdr.nentries = lex->nentries;
+  hdr.pool_size = lex->pool_size;
+  hdr.longest_root = longest_root(lex);
+  ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1
+    && fwrite(lex->slots, sizeof(LEXSLOT), lex->nslots, f) == lex->nslots
+    && fwrite(lex->pool, 1, lex->pool_size, f) == lex->pool_size;
+  if (fclose(f) != 0 || !ok || rename(tmp, path) != 0)
+    {
+      unlink(tmp);
+      return -1;
+    }
+  return 0;
+}
+
+
+/*
+ * Map an image written by lex_file_save() read-only.  Returns NULL, with
+ * errno set, if there is no such file (ENOENT, or whatever open() gave), if
+ * it isn't a whole, intact image of this version (EINVAL), or if it was
+ * tagged with another stamp (ESTALE).
+ */
+
+LEXICON *lex_file_attach(const char *path, unsigned int stamp)
+{
+  LEXHEADER *hdr;
+  struct stat st;
+  void *mapping;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return NULL;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LEXHEADER))
+    {
+      close(fd);
+      errno = EINVAL;
+      return NULL;
+    }
+  mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return NULL;
+
+  hdr = (LEXHEADER *)mapping;
+  if (hdr->magic != LEX_MAGIC || hdr->version != LEX_VERSION || !image_intact(hdr, st.st_size))
+    {
+      munmap(mapping, st.st_size);
+      errno = EINVAL;
+      return NULL;
+    }
+  if (hdr->stamp != stamp)
+    {
+      munmap(mapping, st.st_size);
+      errno = ESTALE;
+      return NULL;
+    }
+  return view(mapping, st.st_size);
+}
+
+
+
+/*
+ * A read-only copy of a lexicon, in memory of its own: on NUMA node `node'
+ * (or wherever the kernel likes, if node is -1), and in huge pages if pages
+ * asks for them.  The lookups touch slots all over the table, so with small
+ * pages nearly every one is a TLB miss.  LEX_HUGETLB_PAGES falls back to
+ * transparent huge pages if no hugetlbfs pages are reserved.  Returns NULL
+ * if the memory can't be mapped.
+ */
+
+LEXICON *lex_replicate(const LEXICON *lex, int node, int pages)
+{
+  size_t slots_size = (size_t)lex->nslots * sizeof(LEXSLOT);
+  size_t size = slots_size + lex->pool_size;
+  void *mapping = MAP_FAILED;
+  LEXICON *copy;
+
+  if (pages != LEX_SMALL_PAGES)
+    size = (size + HUGE_PAGE - 1) & ~(size_t)(HUGE_PAGE - 1);
+#ifdef MAP_HUGETLB
+  if (pages == LEX_HUGETLB_PAGES)
+    mapping = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (mapping == MAP_FAILED)
+    {
+      if (pages == LEX_SMALL_PAGES)
+	mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      else
+	mapping = map_aligned(size);
+      if (mapping == MAP_FAILED)
+	return NULL;
+#ifdef MADV_HUGEPAGE
+      if (pages != LEX_SMALL_PAGES)
+	madvise(mapping, size, MADV_HUGEPAGE);
+#endif
+    }
+
+  /* the pages are placed when the copy first touches them */
+  prefer_node(mapping, size, node);
+  memcpy(mapping, lex->slots, slots_size);
+  memcpy((char *)mapping + slots_size, lex->pool, lex->pool_size);
+  mprotect(mapping, size, PROT_READ);
+
+  copy = (LEXICON *)calloc(1, sizeof(LEXICON));
+  copy->nslots = lex->nslots;
+  copy->nentries = lex->nentries;
+  copy->slots = (LEXSLOT *)mapping;
+  copy->pool = (char *)mapping + slots_size;
+  copy->pool_size = lex->pool_size;
+  copy->pool_cap = lex->pool_size;
+  copy->mapping = mapping;
+  copy->mapping_size = size;
+  return copy;
+}
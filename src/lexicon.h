@@ -0,0 +1,85 @@
+/*
+ * A pointer-free, offset-based image of the stemmer's dictionary.
+ *
+ * Words and roots live in a string pool and are referred to by their offset
+ * into it, and the words are indexed by an open-addressing table of slots.
+ * Because nothing in the image is a pointer, it can be placed in a named
+ * POSIX shared-memory segment by one process and mapped read-only by any
+ * number of others.  The same image can be written to a file and mapped
+ * back from it (lex_file_save(), lex_file_attach()).
+ *
+ * The table doubles as words are added, and there is no limit on the length
+ * of a word or the number of words, other than the 4GB the offsets can
+ * address.
+ */
+
+#define LEX_MAGIC   0x58454c4b  /* "KLEX" */
+#define LEX_VERSION 2
+
+/* pages for lex_replicate() */
+#define LEX_SMALL_PAGES    0
+#define LEX_HUGE_PAGES     1  /* transparent huge pages */
+#define LEX_HUGETLB_PAGES  2  /* explicit (hugetlbfs) huge pages, if any are reserved */
+
+#define LEX_E_EXCEPTION 1     /* the word is an exception to the "e" ending rule */
+#define LEX_REMOVED     2     /* the word has been removed from the dictionary */
+
+
+/* the header at the start of a shared image; the slots follow it, and then
+   the string pool */
+typedef struct
+{
+  unsigned int magic;
+  unsigned int version;
+  unsigned int ready;          /* set last, once the rest of the image is written */
+  unsigned int stamp;          /* identifies the lexicon files the image was built from */
+  unsigned int nslots;         /* always a power of two */
+  unsigned int nentries;
+  unsigned int pool_size;
+  unsigned int longest_root;   /* the length of the longest root (0 if unknown) */
+  unsigned int publisher;      /* the process writing a shared image, until it is ready */
+  unsigned int pad;
+} LEXHEADER;
+
+/* one slot of the table.  Offset 0 of the pool holds an empty string, so a
+   key of 0 marks an empty slot, and a root of 0 means "no root". */
+typedef struct
+{
+  unsigned int hash;
+  unsigned int key;            /* pool offset of the word */
+  unsigned int root;           /* pool offset of the root form */
+  unsigned int flags;
+} LEXSLOT;
+
+typedef struct lexicon
+{
+  unsigned int nslots;
+  unsigned int nentries;
+  LEXSLOT *slots;
+  char *pool;
+  unsigned int pool_size;
+  size_t pool_cap;             /* bytes allocated for the pool */
+  void *mapping;               /* the shared segment, if the lexicon is attached */
+  unsigned int longest_root;   /* from the header, if the lexicon is attached; else 0 */
+  size_t mapping_size;
+  struct lexicon *retired;     /* links lexicons waiting to be freed */
+} LEXICON;
+
+
+/* Prototypes of the lexicon functions */
+
+unsigned int lex_hash(const char *key);
+LEXICON *lex_create(unsigned int nwords, unsigned int pool_bytes);
+int lex_add(LEXICON *lex, const char *key, const char *root, unsigned int flags);
+int lex_set_flags(LEXICON *lex, const char *key, unsigned int flags);
+void lex_free(LEXICON *lex);
+const LEXSLOT *lex_find(const LEXICON *lex, const char *key);
+unsigned int lex_stamp(const char *stemdir);
+unsigned int lex_image_stamp(const char *stemdir);
+LEXICON *lex_shm_attach(const char *name, unsigned int stamp);
+LEXICON *lex_shm_publish(const char *name, const LEXICON *lex, unsigned int stamp);
+unsigned int lex_checksum(const char *stemdir);
+int lex_file_save(const char *path, const LEXICON *lex, unsigned int stamp);
+LEXICON *lex_file_attach(const char *path, unsigned int stamp);
+LEXICON *lex_replicate(const LEXICON *lex, int node, int pages);
+
@@ -0,0 +1,132 @@
+/*
+   make-hot-words - generate the table of hot words (see hot-words.h).
+
+   The words of the frequency list (one per line, most frequent first;
+   lines starting with '#' are comments) are stemmed by the reference
+   stemmer with the lexicon in STEM_DIR, and the first HOT_WORDS that fit
+   (all lower-case letters, fewer than HOT_LENGTH of them, and a stem
+   short enough) are placed in an open-addressed table, which is written
+   out as C.  Several multipliers for the hash are tried, and the one that
+   needs the fewest probes to find any word is kept.
+
+   usage:  make-hot-words frequency-list table.h
+
+   The stemmer checks each entry against its own lexicon the first time
+   the word comes up (the lexicon may not be the one the table was built
+   with), so a stale entry is never used.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "hot-words.h"
+#include "reference-kstem.h"
+
+#define MAXLINE 1024
+#define TRIES 20000              /* multipliers tried */
+
+
+static HOTWORD words[HOT_WORDS];
+static unsigned int nwords = 0;
+
+static HOTWORD table[HOT_SLOTS];
+
+static int fits(const char *w)
+{
+   size_t i, len = strlen(w);
+
+   if (len == 0 || len >= HOT_LENGTH)
+      return 0;
+   for (i = 0; i < len; i++)
+      if (!islower((unsigned char)w[i]))
+         return 0;
+   for (i = 0; i < nwords; i++)
+      if (strcmp(words[i].word, w) == 0)
+         return 0;                             /* listed twice */
+   return 1;
+}
+
+/* fill the table with the words, hashed with multiplier, and return the
+   most probes any of them needs (or for a word that isn't there, since
+   the search stops at an empty slot or after that many) */
+
+static unsigned int fill(uint64_t multiplier)
+{
+   unsigned int i, slot, n, most = 0;
+
+   memset(table, 0, sizeof(table));
+   for (i = 0; i < nwords; i++)  {
+      slot = hot_hash(hot_key(words[i].word, strlen(words[i].word)), multiplier);
+      for (n = 1; table[slot].word[0] != '\0'; n++)
+         slot = (slot + 1) % HOT_SLOTS;
+      table[slot] = words[i];
+      if (n > most)
+         most = n;
+      }
+   return most;
+}
+
+
+int main (int argc, char *argv[]) {
+
+   char line[MAXLINE], thestem[MAXLINE + 256];
+   uint64_t multiplier = 0x9e3779b97f4a7c15ULL, best = multiplier;
+   unsigned int slot, probes, fewest;
+   FILE *list, *out;
+   int i;
+
+   if (argc != 3)  {
+      fprintf(stderr, "usage: make-hot-words frequency-list table.h\n");
+      exit(1);
+      }
+   if ((list = fopen(argv[1], "r")) == NULL)  {
+      fprintf(stderr, "make-hot-words: couldn't read %s\n", argv[1]);
+      exit(1);
+      }
+   ref_read_dict_info();
+
+   while (nwords < HOT_WORDS && fgets(line, sizeof(line), list) != NULL)  {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (line[0] == '#' || !fits(line))
+         continue;
+      ref_stem(line, thestem);
+      if (strlen(thestem) >= HOT_LENGTH)
+         continue;
+      strcpy(words[nwords].word, line);
+      strcpy(words[nwords].stem, thestem);
+      nwords++;
+      }
+   fclose(list);
+
+   /* the multipliers are odd, from a fixed sequence, so the table is the
+      same every time it is built */
+   fewest = fill(best);
+   for (i = 0; i < TRIES && fewest > 1; i++)  {
+      multiplier = multiplier * 6364136223846793005ULL + 1442695040888963407ULL;
+      probes = fill(multiplier | 1);
+      if (probes < fewest)  {
+         fewest = probes;
+         best = multiplier | 1;
+         }
+      }
+   fill(best);
+
+   if ((out = fopen(argv[2], "w")) == NULL)  {
+      fprintf(stderr, "make-hot-words: couldn't write %s\n", argv[2]);
+      exit(1);
+      }
+   fprintf(out, "/* generated by make-hot-words from %s: do not edit */\n\n", argv[1]);
+   fprintf(out, "#define HOT_COUNT %u\n", nwords);
+   fprintf(out, "#define HOT_PROBES %u\n", fewest);
+   fprintf(out, "#define HOT_MULTIPLIER 0x%016llxULL\n\n", (unsigned long long)best);
+   fprintf(out, "static const HOTWORD hot_words[HOT_SLOTS] __attribute__((aligned(64))) = {\n");
+   for (slot = 0; slot < HOT_SLOTS; slot++)
+      fprintf(out, "   { \"%s\", \"%s\" }%s\n", table[slot].word, table[slot].stem,
+              slot + 1 < HOT_SLOTS ? "," : " };");
+   if (fclose(out) != 0)  {
+      fprintf(stderr, "make-hot-words: couldn't write %s\n", argv[2]);
+      exit(1);
+      }
+   return 0;
+}
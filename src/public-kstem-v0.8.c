@@ -40,10 +40,6 @@
                  I added a few constraints to rules for the -ble, 
                   -nce, and -ncy endings.
 
-
-   To-Do: 1) Change the code to explicitly malloc the strings rather than 
-             have them allocated in an array.
-
 */
 
 
@@ -51,14 +47,26 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
-#include "hash.h"             /* hash tables */
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "kstem.h"            /* the public interface */
+#include "lexicon.h"          /* the dictionary table */
+#include "trie.h"             /* the dictionary as a trie, with KSTEM_TRIE */
+#include "rcu.h"              /* lock-free reading of runtime changes */
+#include "hot-words.h"        /* the most frequent words, stemmed in advance */
+#include "hot-words-table.h"
 
 #define vowel(i) (!consonant(i))
 
-#define MAX_WORD_LENGTH 25
-#define MAX_FILENAME_LENGTH 125  /* including the full directory path */
-#define MAX_ROOTS 35000           /* maximum number of root forms in the lexicon */
-#define HASH_DICT_SIZE 40000
+#define MAX_RETIRED 32            /* old versions of the runtime changes kept before freeing */
+#define HOME_CHECK 1024           /* stems between checks of which NUMA node a thread is on */
+#define MAX_PREFIX 64             /* the longest prefix of a word the trie walk records */
+#define WORD_PAD 8                /* bytes readable past the end of word (see ends()) */
 #define TRUE 1
 #define FALSE 0
 
@@ -70,8 +78,8 @@
 #define final_c    (word[k])   /* the last character of word */
 #define penult_c   (word[k-1]) /* the penultimate character of word */
 
-#define ends_in(s) ends(s, sizeof(s)-1)      /* s must be a string constant */
-#define setsuffix(s) setsuff(s, sizeof(s)-1) /* s must be a string constant */
+#define ends_in(s) ends<sizeof(s)-1, pack_suffix(s, sizeof(s))>()   /* s must be a string constant */
+#define setsuffix(s) setsuff<sizeof(s)-1>(s)                       /* s must be a string constant */
 
 
 
@@ -86,34 +94,79 @@ typedef struct
 
 /* ------------------------- Function Declarations --------------------------*/
 
+static void prepare_fast_paths();
+static void prepare_cache();
 
 
 /* ------------------------------ Definitions -------------------------------*/
 
-char *word;
+/* None of these are visible outside this file; kstem.h is the interface.
+   The per-call stemming state is thread-local so that several threads (e.g.,
+   the workers in kstemd) can call stem() at the same time.  The dictionary
+   itself is only read once it has been loaded. */
+
+static __thread char *word;
 
-void *lookup_value;
+static __thread char *work = NULL;     /* where word is stemmed, with WORD_PAD spare bytes */
 
+static __thread size_t work_size = 0;
 
-int j;    /* INDEX of final letter in stem (within word) */
-int k;    /* INDEX of final letter in word.
+static __thread void *lookup_value;
+
+
+static __thread int j;    /* INDEX of final letter in stem (within word) */
+static __thread int k;    /* INDEX of final letter in word.
 	     You must add 1 to k to get the current length of word.  
 	     When you want the length of word, use the macro wordlength,
 	     which is #defined as (k+1).  Note that wordlength is only
              used for its value (never assigned to), so this is ok. */
 
 
-boolean dict_initialized_flag = FALSE;  /* ensure we load it before using it */
+static boolean dict_initialized_flag = FALSE;  /* ensure we load it before using it */
+
+static LEXICON *dict;                          /* the table used to store the dictionary */
+
+static LEXICON **replicas = NULL;              /* with KSTEM_NUMA, a copy of dict on each NUMA node */
+
+static unsigned int nreplicas = 0;
+
+static __thread const LEXICON *home_dict;      /* the copy of dict this thread uses */
+
+static __thread unsigned int home_calls;       /* stems since home_dict was chosen */
+
+static LEXTRIE *dict_trie = NULL;              /* with KSTEM_TRIE, a trie over dict */
+
+static __thread char prefix_word[MAX_PREFIX+1];             /* the word the trie was walked with */
 
-HASH *dict_ht;                          /* the hashtable used to store the dictionary */
+static __thread unsigned int prefix_slots[MAX_PREFIX+1];    /* which of its prefixes are in dict */
 
-dictentry *dep;                         /* for general use with dictionary entries    */
+static __thread unsigned int prefix_len;                    /* how many prefixes are recorded */
 
-char headword[MAX_ROOTS][MAX_WORD_LENGTH];  /* use an array (instead of char*) because 
-                                                  of the need for separate storage of the 
-                                                  root form in the hash table */
+static __thread dictentry *dep;                /* for general use with dictionary entries    */
 
-int headword_cnt = 0;                  /* for moving through the array of headwords */
+static __thread dictentry found_entry;         /* what lookup() returns */
+
+static __thread LEXICON *overlay = NULL;       /* consulted before the dictionary, if set */
+
+static LEXICON *runtime_changes = NULL;        /* words added or removed while running (see kstem_add_word()) */
+
+static __thread LEXICON *live;                 /* the version of runtime_changes this call of stem() uses */
+
+static pthread_mutex_t runtime_lock = PTHREAD_MUTEX_INITIALIZER;   /* serializes the changes */
+
+static LEXICON *retired = NULL;                /* old versions of runtime_changes, waiting to be freed */
+
+static int nretired = 0;
+
+static unsigned long dict_generation = 0;      /* counts the changes, so cached stems can be checked */
+
+static size_t longest_root = 0;                /* the longest root in any table, for kstem_stem_size() */
+
+static boolean fast_ready = FALSE;             /* the fast paths agree with the dictionary (see fast_stem()) */
+
+static unsigned char hot_checked[HOT_SLOTS];   /* whether each stem of hot_words[] agrees with this lexicon */
+
+static uint64_t short_stems[27*27];            /* the stems of the one- and two-letter words, once known */
 
 
 
@@ -122,86 +175,288 @@ int headword_cnt = 0;                  /* for moving through the array of headwo
 /* -------------------------- Function Definitions --------------------------*/
 
 
-/* read_dict_info() reads the words from the dictionary and puts them into a
-                    hash table.  It also stores the other lexicon information
-                    required by the stemmer (proper noun information, supplemental
-                    dictionary files, direct mappings for irregular variants, etc.)
-*/
+/* with KSTEM_TIMING set in the environment, say how long loading took */
 
-void read_dict_info() 
+static void report_load_time(struct timeval *start, const char *how, unsigned int nwords)
 {
+   struct timeval now;
 
-   FILE *dict_file;                      /* main list of words in dictionary */
-   FILE *e_exception_file;               /* exceptions to "e" ending (suited/suit, suites/suite) */
-   FILE *dict_supplement_file;           /* words not found in the basic dictionary list */
-   FILE *proper_noun_file;               /* so we don't have Paris->Pari or Inverness->Inver */
-   FILE *country_nationality_file;       /* Italian->Italy, French->France, etc. */
-   FILE *direct_conflation_file;         /* variants that can be directly conflated */
+   if (!getenv("KSTEM_TIMING"))
+      return;
+   gettimeofday(&now, NULL);
+   fprintf(stderr, "kstem: %s %u dictionary entries in %.3f ms\n", how, nwords,
+           (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_usec - start->tv_usec) / 1000.0);
+}
 
 
-   char *stemdir;                         /* the directory where all these files reside */
-   char currentfile[MAX_FILENAME_LENGTH]; /* the current lexicon file */
- 
-   char *variant;
-   char *root;
-   
-   dict_ht = create_hash(HASH_DICT_SIZE);
 
+/* remember the length of the longest root form, which a stem can be as long as */
 
-   /* the hash table package allows a pointer to be associated with each word stored in
-      the hash table.  The pointer is pointing to a structure  with two fields, one that 
-      tells whether the word is an exception to words ending in "e" 
-      (e.g., `automating'->`automate', but `doing'->`do').  The other field is 
-      used for a direct conflation (e.g., irregular variants, and mapping between 
-      nationalites and countries (`Italian'->`Italy')), and for caching the results
-      of stemming. */
+static void note_root(size_t len)
+{
+   size_t cur = __atomic_load_n(&longest_root, __ATOMIC_RELAXED);
 
-    
-   /* get the directory name from an environment variable, and then build
-      the name of the file (including the path) in the variable "currentfile" */
+   while (len > cur && !__atomic_compare_exchange_n(&longest_root, &cur, len, FALSE,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      ;
+}
 
-   stemdir = getenv("STEM_DIR");
-   if (!stemdir)  {
-      fprintf(stderr, "Error!  The environment variable STEM_DIR is not defined.\nIt must be set to the directory that contains files used by the stemmer.\n");
-      exit(0);
-      }   
-   if (strlen(stemdir) > 100) {
-      fprintf(stderr, "Error!  The directory path in the environment variable STEM_DIR is                       too long. \nThe limit is 100 characters.\n");
-      exit(0);
+static void note_roots(const LEXICON *lex)
+{
+   unsigned int i;
+
+   if (lex->longest_root != 0)  {          /* recorded in a mapped image */
+      note_root(lex->longest_root);
+      return;
       }
+   for (i = 0; i < lex->nslots; i++)
+      if (lex->slots[i].key != 0 && lex->slots[i].root != 0)
+         note_root(strlen(lex->pool + lex->slots[i].root));
+}
 
 
-   /*  read in a list of words from the general dictionary and store it 
-       in the table */
 
-   strcpy((char *)&currentfile[0], (char *)&stemdir[0]);
-   strcat((char *)&currentfile[0], "/head_word_list.txt");
-   dict_file = fopen(currentfile, "r");
-   if (!dict_file)  {
-      fprintf(stderr, "Error!  Couldn't open dictionary headword file.\n");
-      exit(0);
+/* Where the dictionary lives.  With KSTEM_HUGEPAGES set in the environment,
+   it is copied into huge pages ("explicit" asks for hugetlbfs pages, and
+   anything else for transparent ones), since every lookup lands on a random
+   page of the table.  With KSTEM_NUMA set, on a machine with more than one
+   NUMA node, each node gets a copy in its own memory (in huge pages too if
+   they were asked for), and each thread reads the copy on the node it is
+   running on, checking again every HOME_CHECK stems in case it has moved. */
+
+static unsigned int numa_nodes()
+{
+   FILE *f = fopen("/sys/devices/system/node/online", "r");
+   unsigned int n, highest = 0;
+   int c;
+
+   if (!f)
+      return 1;
+   /* a list of ranges, like "0-3" or "0,2"; only the highest node matters */
+   while (fscanf(f, "%u", &n) == 1)  {
+      if (n > highest)
+         highest = n;
+      if ((c = getc(f)) == EOF)
+         break;
+      }
+   fclose(f);
+   return highest + 1;
+}
+
+static const LEXICON *local_replica()
+{
+   unsigned int cpu, node;
+
+   if (getcpu(&cpu, &node) != 0 || node >= nreplicas)
+      node = 0;
+   return replicas[node];
+}
+
+static void place_dictionary()
+{
+   const char *huge = getenv("KSTEM_HUGEPAGES"), *numa = getenv("KSTEM_NUMA");
+   int pages = LEX_SMALL_PAGES;
+   unsigned int nodes = 1, n;
+   LEXICON *lex;
+
+   if (huge)
+      pages = strcmp(huge, "explicit") == 0 ? LEX_HUGETLB_PAGES : LEX_HUGE_PAGES;
+   if (numa)
+      nodes = numa_nodes();
+
+   if (nodes > 1)  {
+      replicas = (LEXICON **)malloc(nodes * sizeof(LEXICON *));
+      for (n = 0; n < nodes; n++)
+         if ((replicas[n] = lex_replicate(dict, n, pages)) == NULL)
+            replicas[n] = dict;
+      nreplicas = nodes;
       }
+   else if (huge && (lex = lex_replicate(dict, -1, pages)) != NULL)  {
+      lex_free(dict);
+      dict = lex;
+      }
+   if (getenv("KSTEM_TIMING") && (huge || nodes > 1))
+      fprintf(stderr, "kstem: the dictionary is in %s pages, %s\n",
+              huge ? "huge" : "small", nodes > 1 ? "with a copy on each NUMA node" : "on one node");
+}
+
+
+
+/* With KSTEM_TRIE set in the environment, the dictionary is also indexed by
+   a trie (see trie.h).  stem_word() walks the word through it once, which
+   finds every prefix of the word that is in the dictionary, and lookup()
+   answers for a truncation of the word -- which is what the suffix rules
+   ask about most -- from that, rather than hashing it and comparing it. */
+
+static void build_trie()
+{
+   if (getenv("KSTEM_TRIE"))
+      dict_trie = trie_build(dict);
+   if (dict_trie && getenv("KSTEM_TIMING"))
+      fprintf(stderr, "kstem: the dictionary trie has %u states in %u cells (%lu KB)\n",
+              dict_trie->nstates, dict_trie->ncells,
+              (unsigned long)(dict_trie->ncells * sizeof(TRIECELL) / 1024));
+}
+
+static void walk_trie()
+{
+   size_t len = wordlength < MAX_PREFIX ? wordlength : MAX_PREFIX;
+
+   memcpy(prefix_word, word, len);
+   trie_prefixes(dict_trie, word, prefix_slots, len);
+   prefix_len = len;
+}
+
+
+
+/* The six lexicon files are read by separate threads.  Each thread reads its
+   whole file with one read(), and splits it into words in place (the same
+   words fscanf("%s") would have returned).  The words are then added to the
+   dictionary one file at a time, in the same order as always, so duplicates
+   are reported (and later entries are handled) exactly as before. */
+
+typedef struct
+    {
+    const char *name;      /* file name, relative to STEM_DIR */
+    const char *error;     /* reported if the file can't be read */
+    char *path;
+    char *text;            /* the contents of the file, split into words in place */
+    char **tokens;         /* the words of the file, in order */
+    unsigned int ntokens;
+    size_t size;
+    boolean ok;
+   } lexfile;
 
-   headword_cnt++;
-   root= headword[headword_cnt];
-   fscanf(dict_file, "%s", root);
-   while (!feof(dict_file))  {
-      lookup_value = search_hash(dict_ht, root);
-      /* if the word isn't already there, insert it */
-      if (lookup_value != NULL) { 
-           fprintf(stderr, "Error!  %s (from the general dictionary file) appears to have                    a duplicate entry.\n", root);
-            exit(0);}
-      dep = (dictentry *)malloc(sizeof(dictentry));
-      dep->e_exception = FALSE;
-      dep->root = "";
-      insert_hash(dict_ht, root, (void *)dep);
-      headword_cnt++;
-      root= headword[headword_cnt];
-      fscanf(dict_file, "%s", root);
+enum { HEAD_WORDS, SUPPLEMENT, E_EXCEPTIONS, CONFLATIONS, NATIONALITIES, PROPER_NOUNS, NUM_LEXFILES };
+
+
+static unsigned char is_space[256];     /* the characters that separate words */
+
+static void set_word_separators()
+{
+   int i;
+
+   for (i = 0; i < 256; i++)
+      is_space[i] = isspace(i) != 0;
+}
+
+static void *read_lexicon_file(void *arg)
+{
+   lexfile *f = (lexfile *)arg;
+   struct stat st;
+   ssize_t n;
+   size_t done = 0, cap;
+   unsigned char *p, *end;
+   int fd;
+
+   fd = open(f->path, O_RDONLY);
+   if (fd < 0 || fstat(fd, &st) != 0)  {
+      if (fd >= 0) close(fd);
+      return NULL;
+      }
+   f->size = st.st_size;
+   f->text = (char *)malloc(f->size + 1);
+   while (done < f->size && (n = read(fd, f->text + done, f->size - done)) > 0)
+      done += n;
+   close(fd);
+   f->size = done;
+   f->text[done] = '\0';
+
+   /* there can't be more words than half the bytes in the file (plus one) */
+   cap = done / 2 + 1;
+   f->tokens = (char **)malloc(cap * sizeof(char *));
+   p = (unsigned char *)f->text;
+   end = p + done;
+   while (p < end)  {
+      while (p < end && is_space[*p])
+         p++;
+      if (p == end)
+         break;
+      f->tokens[f->ntokens++] = (char *)p;
+      while (p < end && !is_space[*p])
+         p++;
+      *p++ = '\0';             /* the text has a spare byte at the end for this */
+      }
+   f->ok = TRUE;
+   return NULL;
+}
+
+
+/* a problem with the lexicon files.  Loading stops at the first one;
+   checking them (kstem_check_lexicon()) goes on, to report them all. */
+
+static void lexicon_problem(boolean checking, unsigned int *problems)
+{
+   (*problems)++;
+   if (!checking)
+      exit(0);
+}
+
+
+/* build_dictionary() reads the words from the lexicon files in stemdir and
+                      puts them into a hash table, along with the other
+                      lexicon information required by the stemmer (proper noun
+                      information, supplemental dictionary files, direct
+                      mappings for irregular variants, etc.)
+*/
+
+static LEXICON *build_dictionary(const char *stemdir, boolean checking, unsigned int *problems)
+{
+   lexfile files[NUM_LEXFILES] = {
+      { "head_word_list.txt",      "Error!  Couldn't open dictionary headword file.\n" },
+      { "dict_supplement.txt",     "Error!  Couldn't open file of supplemental words to the dictionary.\n" },
+      { "e_exception_words.txt",   "Error!  Couldn't open file of words that are exceptions with 'e' ending.\n" },
+      { "direct_conflations.txt",  "Error!  Couldn't open file of conflation words for the dictionary.\n" },
+      { "country_nationality.txt", "Error!  Couldn't open file of variants associated with the names              of countries.\n" },
+      { "proper_nouns.txt",        "Error!  Couldn't open file of proper nouns.\n" } };
+   pthread_t threads[NUM_LEXFILES];
+
+   char **w;
+   unsigned int i, n, words = 0;
+   size_t bytes = 0;
+   LEXICON *lex;
+
+   /* the lexicon is kept in an offset-based table (see lexicon.h).  Each
+      word has two pieces of information associated with it: whether the word
+      is an exception to words ending in "e" (e.g., `automating'->`automate',
+      but `doing'->`do'), and a root form used for a direct conflation (e.g.,
+      irregular variants, and mapping between nationalites and countries
+      (`Italian'->`Italy')). */
+
+
+   /* read and split all of the files at the same time */
+
+   set_word_separators();
+   for (i = 0; i < NUM_LEXFILES; i++)  {
+      files[i].path = (char *)malloc(strlen(stemdir) + strlen(files[i].name) + 2);
+      sprintf(files[i].path, "%s/%s", stemdir, files[i].name);
+      pthread_create(&threads[i], NULL, read_lexicon_file, &files[i]);
+      }
+   for (i = 0; i < NUM_LEXFILES; i++)  {
+      pthread_join(threads[i], NULL);
+      words += files[i].ntokens;
+      bytes += files[i].size;
       }
+   for (i = 0; i < NUM_LEXFILES; i++)
+      if (!files[i].ok)  {
+         fprintf(stderr, "%s", files[i].error);
+         lexicon_problem(checking, problems);
+         }
+
+   /* every word and root is copied into the lexicon's string pool once, so
+      the table and the pool can be sized from what was read */
+
+   lex = lex_create(words, bytes + words);
 
 
-   fclose(dict_file);
+   /*  the words from the general dictionary */
+
+   w = files[HEAD_WORDS].tokens;
+   for (n = 0; n < files[HEAD_WORDS].ntokens; n++)
+      if (!lex_add(lex, w[n], "", 0))  {
+         fprintf(stderr, "Error!  %s (from the general dictionary file) appears to have                    a duplicate entry.\n", w[n]);
+         lexicon_problem(checking, problems);
+         }
 
 
    /* now store words that are not found in the main dictionary.  I make
@@ -209,189 +464,459 @@ void read_dict_info()
       because this makes it easier to maintain the dictionary and to 
       trace down differences in performance. */
 
-   strcpy((char *)&currentfile[0], (char *)&stemdir[0]);
-   strcat((char *)&currentfile[0], "/dict_supplement.txt");
-   dict_supplement_file = fopen(currentfile, "r");
-   if (!dict_supplement_file)  {
-       fprintf(stderr, "Error!  Couldn't open file of supplemental words to the dictionary.\n");
-       exit(0);
-       }
-
-   headword_cnt++;
-   root= headword[headword_cnt];
-   fscanf(dict_supplement_file, "%s", root);
-   while (!feof(dict_supplement_file))  {
-      lookup_value = search_hash(dict_ht, root);
-      if (lookup_value != NULL) {
-         fprintf(stderr, "Error!  Word %s (from the supplemental dictionary) appears to have                          a duplicate entry.\n", root);
-         exit(0);
+   w = files[SUPPLEMENT].tokens;
+   for (n = 0; n < files[SUPPLEMENT].ntokens; n++)
+      if (!lex_add(lex, w[n], "", 0))  {
+         fprintf(stderr, "Error!  Word %s (from the supplemental dictionary) appears to have                          a duplicate entry.\n", w[n]);
+         lexicon_problem(checking, problems);
          }
-      dep = (dictentry *)malloc(sizeof(dictentry));
-      dep->e_exception = FALSE;
-      dep->root = "";
-      insert_hash(dict_ht, root, (void *)dep);
-      headword_cnt++;
-      root= headword[headword_cnt];
-      fscanf(dict_supplement_file, "%s", root);
-      }
-
-   fclose(dict_supplement_file);
 
 
-   /* read in a list of words that are exceptions to the stemming rule I use 
+   /* mark the words that are exceptions to the stemming rule I use 
       (i.e., if a word can end with an `e', it does).  So, `automating' -> `automate' 
       according to the normal application of the rule, but `doing' shouldn't become 
       `doe'.   These particular exceptions *only* apply to words that might end
       in the letter "e".
     */
 
-   strcpy((char *)&currentfile[0], (char *)&stemdir[0]);
-   strcat((char *)&currentfile[0], "/e_exception_words.txt");
-   e_exception_file = fopen(currentfile,  "r");
-   if (!e_exception_file)  {
-       fprintf(stderr, "Error!  Couldn't open file of words that are exceptions with 'e' ending.\n");
-       exit(0);
-       }
-
-   headword_cnt++;
-   root= headword[headword_cnt];
-   fscanf(e_exception_file, "%s", root);
-   while (!feof(e_exception_file))  {
-       lookup_value = search_hash(dict_ht, root);
-       if (lookup_value == NULL)  {
-           fprintf(stderr, "Error!  %s (from the 'e' ending exception file) was not                   found in the main or supplemental dictioanry.\n", root);
-           exit(0);
-           }
-       dep = (dictentry *)malloc(sizeof(dictentry));
-       dep->e_exception = TRUE;
-       dep->root = "";
-       insert_hash(dict_ht, headword[headword_cnt], (void *)dep);        
-       headword_cnt++;
-       root= headword[headword_cnt];       
-       fscanf(e_exception_file, "%s", root);
-       }
-
-   fclose(e_exception_file);
-
+   w = files[E_EXCEPTIONS].tokens;
+   for (n = 0; n < files[E_EXCEPTIONS].ntokens; n++)
+      if (!lex_set_flags(lex, w[n], LEX_E_EXCEPTION))  {
+         fprintf(stderr, "Error!  %s (from the 'e' ending exception file) was not                   found in the main or supplemental dictioanry.\n", w[n]);
+         lexicon_problem(checking, problems);
+         }
 
 
    /*  store words for which we have a direct conflation.  These are cases that
        would not go through due to length restrictions (`owing'->`owe'), or in which
        the user wishes to over-ride the normal operation of the stemmer */
 
-   strcpy((char *)&currentfile[0], (char *)&stemdir[0]);
-   strcat((char *)&currentfile[0], "/direct_conflations.txt");
-   direct_conflation_file = fopen(currentfile, "r");
-   if (!direct_conflation_file)  {
-      fprintf(stderr, "Error!  Couldn't open file of conflation words for the dictionary.\n");
-      exit(0);
+   w = files[CONFLATIONS].tokens;
+   for (n = 0; n + 1 < files[CONFLATIONS].ntokens; n += 2)
+      if (!lex_add(lex, w[n], w[n+1], 0))  {
+         fprintf(stderr, "Error!  %s (from the direct conflation file) appears to have                    a duplicate entry.\n", w[n]);
+         lexicon_problem(checking, problems);
+         }
+
+
+   /* store the mappings between countries and nationalities (e.g., British/Britain), 
+      and morphology associated with continents (european/europe).  Just as with
+      the previous direct-conflation file, this is a direct mapping from a variant
+      to a root form.  They are kept in separate files for ease of maintenance */
+
+   w = files[NATIONALITIES].tokens;
+   for (n = 0; n + 1 < files[NATIONALITIES].ntokens; n += 2)
+      if (!lex_add(lex, w[n], w[n+1], 0))  {
+         fprintf(stderr, "Error!  Word %s (from the country/nationality file) appears                         to have a duplicate entry.\n", w[n]);
+         lexicon_problem(checking, problems);
+         }
+
+
+   /* finally, store proper nouns that would otherwise be altered by
+      the stemmer (e.g. `Inverness') */
+
+   w = files[PROPER_NOUNS].tokens;
+   for (n = 0; n < files[PROPER_NOUNS].ntokens; n++)
+      if (!lex_add(lex, w[n], "", 0))  {
+         fprintf(stderr, "Error!  %s (from the proper noun file) appears to have                    a duplicate entry\n", w[n]);
+         lexicon_problem(checking, problems);
+         }
+
+
+   /* loading quietly drops a variant left without a root at the end of the
+      two-column files; a check points it out */
+
+   if (checking)
+      for (i = CONFLATIONS; i <= NATIONALITIES; i++)
+         if (files[i].ntokens % 2 != 0)  {
+            fprintf(stderr, "Error!  %s (the last word of %s) has no root form.\n",
+                    files[i].tokens[files[i].ntokens - 1], files[i].path);
+            lexicon_problem(checking, problems);
+            }
+
+   for (i = 0; i < NUM_LEXFILES; i++)  {
+      free(files[i].path);
+      free(files[i].text);
+      free(files[i].tokens);
       }
-     
-   headword_cnt++;
-   variant = headword[headword_cnt];
-   headword_cnt++;
-   root = headword[headword_cnt];
-   fscanf(direct_conflation_file, "%s %s", variant, root);
-   while (!feof(direct_conflation_file))  {
-       lookup_value = search_hash(dict_ht, variant);
-       if (lookup_value != NULL)  {
-           fprintf(stderr, "Error!  %s (from the direct conflation file) appears to have                    a duplicate entry.\n", variant);
-           exit(0);
-           }         
-       dep = (dictentry *)malloc(sizeof(dictentry));
-       dep->e_exception = FALSE;
-       dep->root = root;
-       insert_hash(dict_ht, variant, (void *)dep);
-       headword_cnt++;
-       variant = headword[headword_cnt];
-       headword_cnt++;
-       root = headword[headword_cnt];
-       fscanf(direct_conflation_file, "%s %s", variant, root);
-       }
+   return lex;
+}
 
-   fclose(direct_conflation_file);
 
+/* everything that follows getting the dictionary, however it was got */
 
+static void finish_loading(struct timeval *start, const char *how)
+{
+   note_roots(dict);
+   place_dictionary();
+   build_trie();
+   dict_initialized_flag = TRUE;
+   prepare_fast_paths();
+   prepare_cache();
+   report_load_time(start, how, dict->nentries);
+}
 
 
-   /* store the mappings between countries and nationalities (e.g., British/Britain), 
-      and morphology associated with continents (european/europe).  */
+/* The dictionary image.  kstem-check validates the lexicon files and
+   writes the dictionary it builds from them to an image (by default
+   kstem.image, in STEM_DIR; KSTEM_IMAGE can name another).  If the image
+   is there and was made from files with the same contents as these,
+   read_dict_info() maps it instead of reading the files: nothing is
+   parsed, the table is only checked to hold together (see lex_file_attach()),
+   and the first stem comes within a millisecond.  An image that is there
+   but can't be used is reported, since every start then reads the files. */
+
+static LEXICON *attach_image(const char *stemdir)
+{
+   const char *image = getenv("KSTEM_IMAGE");
+   char *path;
+   LEXICON *lex;
+
+   if (image && *image == '\0')
+      return NULL;
+   path = (char *)malloc(strlen(stemdir) + sizeof("/kstem.image"));
+   sprintf(path, "%s/kstem.image", stemdir);
+   if (image == NULL)
+      image = path;
+   if ((lex = lex_file_attach(image, lex_image_stamp(stemdir))) == NULL && errno != ENOENT)
+      fprintf(stderr, "Warning!  Ignoring the dictionary image %s, which %s.\n"
+              "Run kstem-check to make a new one.\n", image,
+              errno == ESTALE ? "was made from other lexicon files"
+                              : errno == EINVAL ? "is damaged, or from another version of the stemmer"
+                                                : "couldn't be read");
+   free(path);
+   return lex;
+}
+
+
+/* read_dict_info() loads the dictionary: from an image made by kstem-check,
+                    from a shared-memory segment, or from the lexicon files
+                    themselves (see build_dictionary()).
+*/
+
+void read_dict_info() 
+{
+   struct timeval start;
+   char *stemdir;                         /* the directory where all these files reside */
+   char *shm_name;                        /* the shared-memory segment to use, if any */
+   unsigned int stamp = 0, problems = 0;
+   LEXICON *lex;
+
+   gettimeofday(&start, NULL);
 
-   strcpy((char *)&currentfile[0], (char *)&stemdir[0]);
-   strcat((char *)&currentfile[0], "/country_nationality.txt");
-   country_nationality_file = fopen(currentfile, "r");
-   if (!country_nationality_file)  {
-      fprintf(stderr, "Error!  Couldn't open file of variants associated with the names              of countries.\n");
+    
+   /* get the directory name from an environment variable */
+
+   stemdir = getenv("STEM_DIR");
+   if (!stemdir)  {
+      fprintf(stderr, "Error!  The environment variable STEM_DIR is not defined.\nIt must be set to the directory that contains files used by the stemmer.\n");
       exit(0);
+      }   
+
+   if ((dict = attach_image(stemdir)) != NULL)  {
+      finish_loading(&start, "mapped the image of");
+      return;
       }
 
 
-   /* Just as with the previous direct-conflation file, we want to create a direct
-      mapping from a variant to a root form.  In this case the mapping is between
-      country nationalities and the country name (e.g., British->Britain).  They 
-      are kept in separate files for ease of maintenance */
-        
-   headword_cnt++;
-   variant = headword[headword_cnt];
-   headword_cnt++;
-   root = headword[headword_cnt];
-   fscanf(country_nationality_file, "%s %s", variant, root);
-   while (!feof(country_nationality_file))  {
-      lookup_value = search_hash(dict_ht, variant);
-      if (lookup_value != NULL) {
-         fprintf(stderr, "Error!  Word %s (from the country/nationality file) appears                         to have a duplicate entry.\n", variant);
-         exit(0);}
-      dep = (dictentry *)malloc(sizeof(dictentry));
-      dep->e_exception = FALSE;
-      dep->root = root;
-      insert_hash(dict_ht, variant, (void *)dep);
-      headword_cnt++;
-      variant = headword[headword_cnt];
-      headword_cnt++;
-      root = headword[headword_cnt];
-      fscanf(country_nationality_file, "%s %s", variant, root);
+   /* if KSTEM_SHM names a shared-memory segment, another process may already
+      have built the dictionary there.  If so, just map it. */
+
+   shm_name = getenv("KSTEM_SHM");
+   if (shm_name)  {
+      stamp = lex_stamp(stemdir);
+      dict = lex_shm_attach(shm_name, stamp);
+      if (dict)  {
+         finish_loading(&start, "mapped");
+         return;
+         }
       }
 
-   fclose(country_nationality_file);
+   dict = build_dictionary(stemdir, FALSE, &problems);
 
 
+   /* publish the dictionary for the processes that come after us.  If that
+      isn't possible, we simply keep using our own copy. */
 
-   /* finally, store proper nouns that would otherwise be altered by
-      the stemmer (e.g. `Inverness') */
+   if (shm_name)  {
+      lex = lex_shm_publish(shm_name, dict, stamp);
+      if (lex)  {
+         lex_free(dict);
+         dict = lex;
+         }
+      else
+         fprintf(stderr, "Warning!  Couldn't publish the dictionary in shared memory segment %s.\n", shm_name);
+      }
 
+   finish_loading(&start, "loaded");
+}
 
-   strcpy((char *)&currentfile[0], (char *)&stemdir[0]);
-   strcat((char *)&currentfile[0], "/proper_nouns.txt");
-   proper_noun_file = fopen(currentfile, "r");
-   if (!proper_noun_file)  {
-      fprintf(stderr, "Error!  Couldn't open file of proper nouns.\n");
-      exit(0);
+
+/* check the lexicon files in $STEM_DIR, reporting every problem found,
+   and if there are none and image isn't NULL, write the dictionary to it
+   for read_dict_info() to map.  Returns the number of problems. */
+
+int kstem_check_lexicon(const char *image)
+{
+   const char *stemdir = getenv("STEM_DIR");
+   unsigned int problems = 0;
+   LEXICON *lex;
+
+   if (!stemdir)  {
+      fprintf(stderr, "Error!  The environment variable STEM_DIR is not defined.\nIt must be set to the directory that contains files used by the stemmer.\n");
+      return 1;
+      }
+   lex = build_dictionary(stemdir, TRUE, &problems);
+   if (problems == 0 && image && lex_file_save(image, lex, lex_image_stamp(stemdir)) != 0)  {
+      fprintf(stderr, "Error!  Couldn't write the dictionary image %s.\n", image);
+      problems++;
       }
+   lex_free(lex);
+   return problems;
+}
+
+
 
-   headword_cnt++;
-   root = headword[headword_cnt];
-   fscanf(proper_noun_file, "%s", root);
-   while (!feof(proper_noun_file))  {
-      lookup_value = search_hash(dict_ht, root);
-      if (lookup_value != NULL) {
-         fprintf(stderr, "Error!  %s (from the proper noun file) appears to have                    a duplicate entry\n", root);
-           exit(0);}
-      dep = (dictentry *)malloc(sizeof(dictentry));
-      dep->e_exception = FALSE;
-      dep->root = "";
-      insert_hash(dict_ht, root, (void *)dep);
-      headword_cnt++;
-      root = headword[headword_cnt];
-      fscanf(proper_noun_file, "%s", root);
+/* search the dictionary.  An overlay bound to this thread (see
+   kstem_set_overlay()) is searched first, then the changes made while
+   running, and finally the dictionary loaded by read_dict_info(); the first
+   entry found is the one used.  The entry is returned through a thread-local
+   dictentry, which is valid until the next call. */
+
+static void *lookup(char *w)
+{
+   const LEXSLOT *s = NULL;
+   const LEXICON *lex = overlay;
+   size_t len;
+
+   if (lex)
+      s = lex_find(lex, w);
+   if (s == NULL && live)  {
+      lex = live;
+      s = lex_find(lex, w);
+      if (s != NULL && (s->flags & LEX_REMOVED))
+         return NULL;
+      }
+   if (s == NULL)  {
+      lex = home_dict;
+      if (prefix_len > 0 && (len = strlen(w)) <= prefix_len && memcmp(w, prefix_word, len) == 0)  {
+         /* a prefix of the word the trie was walked with: already known */
+         if (prefix_slots[len] == 0)
+            return NULL;
+         s = &lex->slots[prefix_slots[len] - 1];
+         }
+      else if ((s = lex_find(lex, w)) == NULL)
+         return NULL;
       }
+   found_entry.e_exception = (s->flags & LEX_E_EXCEPTION) != 0;
+   found_entry.root = lex->pool + s->root;
+   return (void *)&found_entry;
+}
 
-   fclose(proper_noun_file);
 
 
-   dict_initialized_flag = TRUE;
+/* read_overlay_info() reads a small set of additions to the dictionary, such
+                       as the proper nouns and direct conflations of one tenant,
+                       from the lexicon files found in dir.  Any of
+                       dict_supplement.txt, e_exception_words.txt,
+                       direct_conflations.txt, country_nationality.txt and
+                       proper_nouns.txt may be present, in the same format as
+                       under STEM_DIR.  A word in the overlay replaces the
+                       dictionary's entry for it, so an overlay can also stop
+                       a conflation (by listing the variant as a word).
+
+   The overlay is consulted by stem() on threads that bind it with
+   kstem_set_overlay(), so one loaded dictionary can serve any number of
+   overlays, and switching between them costs nothing.  Returns NULL (after
+   reporting why) if the overlay has errors.
+*/
+
+LEXICON *read_overlay_info(const char *dir)
+{
+   static const char *names[] = { NULL, "dict_supplement.txt", "e_exception_words.txt",
+      "direct_conflations.txt", "country_nationality.txt", "proper_nouns.txt" };
+   lexfile f;
+   LEXICON *lex;
+   const LEXSLOT *s;
+   unsigned int i, n;
+   int ok = TRUE;
+
+   if (!dict_initialized_flag)  {
+      fprintf(stderr, "Error!  Dictionary was not initialized.\n              A call to read_dict_info() must be made before reading an overlay.\n");
+      return NULL;
+      }
+
+   set_word_separators();
+   lex = lex_create(0, 0);
+   for (i = SUPPLEMENT; i < NUM_LEXFILES && ok; i++)  {
+      memset(&f, 0, sizeof(f));
+      f.path = (char *)malloc(strlen(dir) + strlen(names[i]) + 2);
+      sprintf(f.path, "%s/%s", dir, names[i]);
+      read_lexicon_file(&f);
+
+      for (n = 0; n < f.ntokens && ok; n++)  {
+         switch (i)  {
+            case E_EXCEPTIONS:
+               /* mark the word, taking its entry from the dictionary if need be */
+               if (!lex_set_flags(lex, f.tokens[n], LEX_E_EXCEPTION))  {
+                  s = lex_find(dict, f.tokens[n]);
+                  if (s == NULL)  {
+                     fprintf(stderr, "Error!  %s (from the 'e' ending exception file in %s) was not found in the dictionary or the overlay.\n", f.tokens[n], dir);
+                     ok = FALSE;
+                     break;
+                     }
+                  lex_add(lex, f.tokens[n], dict->pool + s->root, s->flags | LEX_E_EXCEPTION);
+                  }
+               break;
+            case CONFLATIONS:
+            case NATIONALITIES:
+               if (n + 1 >= f.ntokens)
+                  break;
+               if (!lex_add(lex, f.tokens[n], f.tokens[n+1], 0))  {
+                  fprintf(stderr, "Error!  %s (from %s) appears to have a duplicate entry in the overlay.\n", f.tokens[n], f.path);
+                  ok = FALSE;
+                  }
+               n++;
+               break;
+            default:
+               if (!lex_add(lex, f.tokens[n], "", 0))  {
+                  fprintf(stderr, "Error!  %s (from %s) appears to have a duplicate entry in the overlay.\n", f.tokens[n], f.path);
+                  ok = FALSE;
+                  }
+            }
+         }
+      free(f.path);
+      free(f.text);
+      free(f.tokens);
+      }
+
+   if (!ok)  {
+      lex_free(lex);
+      return NULL;
+      }
+   note_roots(lex);
+   return lex;
 }
 
 
+/* bind an overlay to the calling thread (NULL for the dictionary alone).
+   The overlay must not be freed while a thread still has it bound. */
+
+void kstem_set_overlay(LEXICON *lex)
+{
+   overlay = lex;
+}
+
+
+
+/* Changes to the dictionary while stemming is going on.  The changes are
+   kept in a small table of their own, searched before the dictionary.  A
+   change copies that table, modifies the copy, and publishes it with one
+   atomic store, so stem() never waits; the old copy is freed once no call
+   of stem() can still be using it.  Each change therefore costs time in
+   proportion to the number of changes so far, which is meant to stay small
+   (trending names, corrections), not to rival the dictionary.  Returns 0 on
+   success, -1 if the dictionary isn't loaded or the word is empty or all
+   white space (which no token can be). */
+
+static int change_dictionary(const char *w, const char *root, unsigned int flags)
+{
+   LEXICON *old, *changed;
+   const char *p;
+   char *key;
+   unsigned int i;
+
+   for (p = w; *p && isspace((unsigned char)*p); p++)
+      ;
+   if (!dict_initialized_flag || *p == '\0')
+      return -1;
+
+   key = strdup(w);
+   for (i = 0; key[i]; i++)
+      key[i] = tolower(key[i]);
+
+   note_root(strlen(root));
+   pthread_mutex_lock(&runtime_lock);
+   old = runtime_changes;
+
+   /* copy the earlier changes, except any to this word.  Removing a word
+      the dictionary doesn't have only needs the earlier change dropped. */
+   changed = lex_create(old ? old->nentries + 1 : 1, 0);
+   if (!((flags & LEX_REMOVED) && lex_find(dict, key) == NULL))
+      lex_add(changed, key, root, flags);
+   if (old)
+      for (i = 0; i < old->nslots; i++)
+         if (old->slots[i].key != 0 && strcmp(old->pool + old->slots[i].key, key) != 0)
+            lex_add(changed, old->pool + old->slots[i].key,
+                    old->pool + old->slots[i].root, old->slots[i].flags);
+
+   __atomic_store_n(&runtime_changes, changed, __ATOMIC_RELEASE);
+   __atomic_add_fetch(&dict_generation, 1, __ATOMIC_RELEASE);
+   __atomic_store_n(&fast_ready, FALSE, __ATOMIC_RELAXED);   /* the stems in advance may be wrong now */
+
+   /* the old table can only be freed once no reader can be using it.
+      Waiting for that after every change would make a burst of changes
+      crawl, so old tables are collected and freed together. */
+   if (old)  {
+      old->retired = retired;
+      retired = old;
+      if (++nretired >= MAX_RETIRED)  {
+         rcu_synchronize();
+         while (retired)  {
+            old = retired;
+            retired = old->retired;
+            lex_free(old);
+            }
+         nretired = 0;
+         }
+      }
+   pthread_mutex_unlock(&runtime_lock);
+   free(key);
+   return 0;
+}
+
+
+/* add a word to the dictionary (e.g., a proper noun that shouldn't be stemmed) */
+
+int kstem_add_word(const char *w)
+{
+   return change_dictionary(w, "", 0);
+}
+
+/* conflate variant directly to root, as in direct_conflations.txt */
+
+int kstem_add_conflation(const char *variant, const char *root)
+{
+   return change_dictionary(variant, root, 0);
+}
+
+/* remove a word (or a direct conflation) from the dictionary */
+
+int kstem_remove(const char *w)
+{
+   return change_dictionary(w, "", LEX_REMOVED);
+}
+
+/* the number of changes made so far.  Anything computed from the dictionary
+   (e.g., a cache of stems) is stale once this changes. */
+
+unsigned long kstem_dictionary_generation()
+{
+   return __atomic_load_n(&dict_generation, __ATOMIC_ACQUIRE);
+}
+
+
+
+/* the storage stem() needs for a term of len characters: -ic can become
+   -ical, and a direct conflation can give any root in the dictionary */
+
+size_t kstem_stem_size(size_t len)
+{
+   size_t root = __atomic_load_n(&longest_root, __ATOMIC_RELAXED);
+
+   return (len + 2 > root ? len + 2 : root) + 1;
+}
+
 
 
 /* consonant() returns TRUE if word[i] is a consonant.  (The recursion is safe.) */
@@ -448,17 +973,45 @@ static boolean doublec (int i)
    section of this module) which takes str and determines its length at compile
    time.  Note that str must therefore no longer be padded with spaces in the calls 
    to ends_in (as it was in the original version of this code).
+
+   The macro goes further: the suffix and its terminating '\0' (never more than
+   eight bytes) are packed into an integer constant at compile time, and ends()
+   compares the tail of the word with it using a single eight-byte load and a
+   mask.  word is kept in a buffer with WORD_PAD spare bytes at the end (see
+   stem()), so the load never runs past it.
 */
 
-static boolean ends(char *str, int sufflength)
+static constexpr unsigned long long pack_suffix(const char *str, int n)
 {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return n == 0 ? 0 : pack_suffix(str, n-1) | ((unsigned long long)(unsigned char)str[n-1] << (8 * (8-n)));
+#else
+    return n == 0 ? 0 : pack_suffix(str, n-1) | ((unsigned long long)(unsigned char)str[n-1] << (8 * (n-1)));
+#endif
+}
+
+static constexpr unsigned long long suffix_mask(int n)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return n == 8 ? ~0ULL : ~(~0ULL >> (8 * n));
+#else
+    return n == 8 ? ~0ULL : (1ULL << (8 * n)) - 1;
+#endif
+}
+
+template <int sufflength, unsigned long long packed>
+static inline boolean ends()
+{
+    static_assert(sufflength < 8, "a suffix and its '\\0' must fit in eight bytes");
     int r = wordlength - sufflength;    /* length of word before this suffix */
+    unsigned long long tail;
     boolean match;
 
     if (sufflength > k)
 	return(FALSE);
     
-    match = (strcmp((char *)word+r, (char *)str) == 0);
+    memcpy(&tail, word + r, sizeof(tail));
+    match = ((tail & suffix_mask(sufflength + 1)) == packed);
     j = (match ? r-1 : k);             /* use r-1 since j is an index rather than length */
     return(match);
 }
@@ -466,13 +1019,13 @@ static boolean ends(char *str, int sufflength)
 
 
 
-/* replace old suffix with str */
+/* replace old suffix with str (a fixed-size copy, '\0' included) */
 
-static void setsuff(char *str, int length)
+template <int length>
+static inline void setsuff(const char *str)
 {
-    strcpy((char *)word+j+1, (char *)str);
+    memcpy(word+j+1, str, length+1);
     k = j + length;
-    word[k+1] = '\0';
 }
 
 
@@ -482,14 +1035,14 @@ static void setsuff(char *str, int length)
 static void plural ()
 {
 
-   if (search_hash(dict_ht, word) != NULL)
+   if (lookup(word) != NULL)
       return;
   
    if (final_c == 's')  {
       if (ends_in("ies")) {
          word[j+3] = '\0';
          k--;
-         if (search_hash(dict_ht, word) != NULL)        /* ensure calories -> calorie */
+         if (lookup(word) != NULL)        /* ensure calories -> calorie */
             return;
          k++;
          word[j+3] = 's';             
@@ -507,14 +1060,14 @@ static void plural ()
               noun (a type of racket used in lacrosse), but the verb is much more
               common */
 
-           if ((search_hash(dict_ht, word) != NULL)  && !((word[j] == 's') && (word[j-1] == 's')))
+           if ((lookup(word) != NULL)  && !((word[j] == 's') && (word[j-1] == 's')))
               return;
 
            /* try removing the "es" */
 
            word[j+1] = '\0';
            k--;
-           if (search_hash(dict_ht, word) != NULL)
+           if (lookup(word) != NULL)
               return;
 
            /* the default is to retain the "e" */
@@ -539,7 +1092,7 @@ static void plural ()
 static void past_tense ()
 {
 
-  if (search_hash(dict_ht, word) != NULL)
+  if (lookup(word) != NULL)
      return;
 
   /* Handle words less than 5 letters with a direct mapping  
@@ -551,7 +1104,7 @@ static void past_tense ()
   if (ends_in("ied"))  {
      word[j+3] = '\0';
      k--;
-     if (search_hash(dict_ht, word) != NULL) /* we almost always want to convert -ied to -y, but */
+     if (lookup(word) != NULL) /* we almost always want to convert -ied to -y, but */
         return;                            /* this isn't true for short words (died->die)      */
      k++;                                  /* I don't know any long words that this applies to, */
      word[j+3] = 'd';                      /* but just in case...                              */
@@ -565,7 +1118,7 @@ static void past_tense ()
       word[j+2] = '\0'; 
       k = j + 1;              
 
-      lookup_value = search_hash(dict_ht, word);
+      lookup_value = lookup(word);
       if (lookup_value != NULL)
          dep = (dictentry *)lookup_value;
       if ((lookup_value != NULL) && !(dep->e_exception))    /* if it's in the dictionary and not an exception */
@@ -574,7 +1127,7 @@ static void past_tense ()
       /* try removing the "ed" */
       word[j+1] = '\0';
       k = j;
-      if (search_hash(dict_ht, word) != NULL)
+      if (lookup(word) != NULL)
          return;
 
 
@@ -586,7 +1139,7 @@ static void past_tense ()
       if (doublec(k))  {
          word[k] = '\0';
          k--;
-         if (search_hash(dict_ht, word) != NULL)
+         if (lookup(word) != NULL)
              return;
          word[k+1] = word[k];
          k++;
@@ -626,7 +1179,7 @@ static void past_tense ()
 static void aspect ()
 {
 
-  if (search_hash(dict_ht, word) != NULL)
+  if (lookup(word) != NULL)
      return;
 
   /* handle short words (aging -> age) via a direct mapping.  This
@@ -645,7 +1198,7 @@ static void aspect ()
      word[j+2] = '\0';
      k = j+1;          
 
-     lookup_value = search_hash(dict_ht, word);
+     lookup_value = lookup(word);
      if (lookup_value != NULL)
      dep = (dictentry *)lookup_value;
 
@@ -657,14 +1210,14 @@ static void aspect ()
      word[k] = '\0';
      k--;                                      /* note that `ing' has also been removed */
 
-     if (search_hash(dict_ht, word) != NULL)
+     if (lookup(word) != NULL)
         return;
 
      /* if I can remove a doubled consonant and get a word, then do so */
      if (doublec(k))  {
         k--;
         word[k+1] = '\0';
-        if (search_hash(dict_ht, word) != NULL)
+        if (lookup(word) != NULL)
            return;
         word[k+1] = word[k];       /* restore the doubled consonant */
 
@@ -711,7 +1264,7 @@ static void ion_endings ()
 {
   int old_k = k;
 
-  if (search_hash(dict_ht, word) != NULL)
+  if (lookup(word) != NULL)
      return;
 
   if (ends_in("ization"))  {   /* the -ize ending is very productive, so simply accept it as the root */
@@ -728,7 +1281,7 @@ static void ion_endings ()
      k = j+1;
 
      /* remove -ition and add `e', and check against the dictionary */
-     if (search_hash(dict_ht, word) != NULL)     
+     if (lookup(word) != NULL)     
         return;                    /* (e.g., definition->define, opposition->oppose) */
 
      /* restore original values */
@@ -744,19 +1297,19 @@ static void ion_endings ()
      k = j+3;         
      
     /* remove -ion and add `e', and check against the dictionary */
-     if (search_hash(dict_ht, word) != NULL)   
+     if (lookup(word) != NULL)   
         return;                  /* (elmination -> eliminate)  */
 
 
      word[j+1] = 'e';            /* remove -ation and add `e', and check against the dictionary */
      word[j+2] = '\0';           /* (allegation -> allege) */
      k = j+1;
-     if (search_hash(dict_ht, word) != NULL)
+     if (lookup(word) != NULL)
         return;
 
      word[j+1] = '\0';           /* just remove -ation (resignation->resign) and check dictionary */
      k = j;
-     if (search_hash(dict_ht, word) != NULL)
+     if (lookup(word) != NULL)
         return;
      
      /* restore original values */
@@ -777,7 +1330,7 @@ static void ion_endings ()
      k = j+1;
      
      /* remove -ication and add `y', and check against the dictionary */
-     if (search_hash(dict_ht, word) != NULL)  
+     if (lookup(word) != NULL)  
         return;                 /* (e.g., amplification -> amplify) */
 
      /* restore original values */
@@ -793,14 +1346,14 @@ static void ion_endings ()
      k = j+1;
 
      /* remove -ion and add `e', and check against the dictionary */
-     if (search_hash(dict_ht, word) != NULL)    
+     if (lookup(word) != NULL)    
         return;
 
      word[j+1] = '\0';
      k = j;
 
      /* remove -ion, and if it's found, treat that as the root */
-     if (search_hash(dict_ht, word) != NULL)    
+     if (lookup(word) != NULL)    
         return;
 
      /* restore original values */
@@ -824,7 +1377,7 @@ static void er_and_or_endings ()
 
   char word_char;                 /* so we can remember if it was -er or -or */
 
-  if (search_hash(dict_ht, word) != NULL)
+  if (lookup(word) != NULL)
     return;
 
   if (ends_in("izer")) {          /* -ize is very productive, so accept it as the root */
@@ -838,7 +1391,7 @@ static void er_and_or_endings ()
      if (doublec(j)) {
         word[j] = '\0';
         k = j - 1;
-        if (search_hash(dict_ht, word) != NULL)
+        if (lookup(word) != NULL)
            return;
         word[j] = word[j-1];       /* restore the doubled consonant */
         }
@@ -848,7 +1401,7 @@ static void er_and_or_endings ()
         word[j] = 'y';
         word[j+1] = '\0';
         k = j;
-        if (search_hash(dict_ht, word) != NULL)  /* yes, so check against the dictionary */
+        if (lookup(word) != NULL)  /* yes, so check against the dictionary */
            return;
         word[j] = 'i';             /* restore the endings */ 
         word[j+1] = 'e';
@@ -858,23 +1411,23 @@ static void er_and_or_endings ()
      if (word[j] == 'e') {         /* handle -eer */
         word[j] = '\0';
         k = j - 1;
-        if (search_hash(dict_ht, word) != NULL)
+        if (lookup(word) != NULL)
            return;
         word[j] = 'e';
         }
        
      word[j+2] = '\0';            /* remove the -r ending */
      k = j+1;
-     if (search_hash(dict_ht, word) != NULL)
+     if (lookup(word) != NULL)
         return;
      word[j+1] = '\0';            /* try removing -er/-or */
      k = j;
-     if (search_hash(dict_ht, word) != NULL)
+     if (lookup(word) != NULL)
         return;
      word[j+1] = 'e';             /* try removing -or and adding -e */
      word[j+2] = '\0';
      k = j+1;
-     if (search_hash(dict_ht, word) != NULL)
+     if (lookup(word) != NULL)
         return;
       
      word[j+1] = word_char;       /* restore the word to the way it was */
@@ -895,18 +1448,18 @@ static void ly_endings ()
 {
    int old_k = k;
 
-   if (search_hash(dict_ht, word) != NULL)
+   if (lookup(word) != NULL)
       return;
 
    if (ends_in("ly")) {
       word[j+2] = 'e';             /* try converting -ly to -le */
-      if (search_hash(dict_ht, word) != NULL)       
+      if (lookup(word) != NULL)       
          return;
       word[j+2] = 'y';
 
       word[j+1] = '\0';            /* try just removing the -ly */
       k = j;
-      if (search_hash(dict_ht, word) != NULL)
+      if (lookup(word) != NULL)
          return;
       if ((word[j-1] == 'a') && (word[j] == 'l'))    /* always convert -ally to -al */
          return;
@@ -923,7 +1476,7 @@ static void ly_endings ()
          word[j] = 'y';
          word[j+1] = '\0';
          k = j;
-         if (search_hash(dict_ht, word) != NULL)
+         if (lookup(word) != NULL)
             return;
          word[j] = 'i';
          word[j+1] = 'l';
@@ -945,19 +1498,19 @@ static void al_endings()
 {
    int old_k = k;
 
-   if (search_hash(dict_ht, word) != NULL)
+   if (lookup(word) != NULL)
       return;
 
    if (ends_in("al"))  {
       word[j+1] = '\0';
       k = j;
-      if (search_hash(dict_ht, word) != NULL)     /* try just removing the -al */
+      if (lookup(word) != NULL)     /* try just removing the -al */
          return;
 
       if (doublec(j))  {            /* allow for a doubled consonant */
         word[j] = '\0';
         k = j-1;
-        if (search_hash(dict_ht, word) != NULL)
+        if (lookup(word) != NULL)
            return;
         word[j] = word[j-1];
         }
@@ -965,13 +1518,13 @@ static void al_endings()
       word[j+1] = 'e';              /* try removing the -al and adding -e */
       word[j+2] = '\0';
       k = j+1;
-      if (search_hash(dict_ht, word) != NULL)
+      if (lookup(word) != NULL)
          return;
 
       word[j+1] = 'u';              /* try converting -al to -um */
       word[j+2] = 'm';              /* (e.g., optimal - > optimum ) */
       k = j+2;
-      if (search_hash(dict_ht, word) != NULL)
+      if (lookup(word) != NULL)
          return;
 
       word[j+1] = 'a';              /* restore the ending to the way it was */
@@ -982,13 +1535,13 @@ static void al_endings()
       if ((word[j-1] == 'i') && (word[j] == 'c'))  {
          word[j-1] = '\0';          /* try removing -ical  */
          k = j-2;
-         if (search_hash(dict_ht, word) != NULL)
+         if (lookup(word) != NULL)
             return;
 
          word[j-1] = 'y';           /* try turning -ical to -y (e.g., bibliographical) */
          word[j] = '\0';
          k = j-1;
-         if (search_hash(dict_ht, word) != NULL)
+         if (lookup(word) != NULL)
             return;
 
          word[j-1] = 'i';
@@ -1001,7 +1554,7 @@ static void al_endings()
       if (word[j] == 'i') {        /* sometimes -ial endings should be removed */
          word[j] = '\0';           /* (sometimes it gets turned into -y, but we */
          k = j-1;                  /* aren't dealing with that case for now) */
-         if (search_hash(dict_ht, word) != NULL)
+         if (lookup(word) != NULL)
             return;
          word[j] = 'i';
          k = old_k;
@@ -1021,19 +1574,19 @@ static void ive_endings()
 {
    int old_k = k;
 
-   if (search_hash(dict_ht, word) != NULL)
+   if (lookup(word) != NULL)
       return;
 
    if (ends_in("ive"))  {
       word[j+1] = '\0';          /* try removing -ive entirely */
       k = j;
-      if (search_hash(dict_ht, word) != NULL)
+      if (lookup(word) != NULL)
          return;
 
       word[j+1] = 'e';           /* try removing -ive and adding -e */
       word[j+2] = '\0';
       k = j+1;
-      if (search_hash(dict_ht, word) != NULL)
+      if (lookup(word) != NULL)
          return;
       word[j+1] = 'i';
       word[j+2] = 'v';
@@ -1042,10 +1595,10 @@ static void ive_endings()
          word[j-1] = 'e';       /* try removing -ative and adding -e */
          word[j] = '\0';        /* (e.g., determinative -> determine) */
          k = j-1;
-         if (search_hash(dict_ht, word) != NULL)
+         if (lookup(word) != NULL)
             return;
          word[j-1] = '\0';     /* try just removing -ative */
-         if (search_hash(dict_ht, word) != NULL)
+         if (lookup(word) != NULL)
             return;
          word[j-1] = 'a';
          word[j] = 't';
@@ -1055,7 +1608,7 @@ static void ive_endings()
        /* try mapping -ive to -ion (e.g., injunctive/injunction) */
        word[j+2] = 'o';
        word[j+3] = 'n';
-       if (search_hash(dict_ht, word) != NULL)
+       if (lookup(word) != NULL)
           return;
 
        word[j+2] = 'v';       /* restore the original values */
@@ -1072,20 +1625,20 @@ static void ize_endings()
 {
   int old_k = k;
 
-  if (search_hash(dict_ht, word) != NULL)
+  if (lookup(word) != NULL)
      return;
 
    if (ends_in("ize"))  {
       word[j+1] = '\0';       /* try removing -ize entirely */
       k = j;
-      if (search_hash(dict_ht, word) != NULL)
+      if (lookup(word) != NULL)
          return;
       word[j+1] = 'i';
 
       if (doublec(j))  {      /* allow for a doubled consonant */
          word[j] = '\0';
          k = j-1;
-        if (search_hash(dict_ht, word) != NULL)
+        if (lookup(word) != NULL)
            return;
         word[j] = word[j-1];
         }
@@ -1093,7 +1646,7 @@ static void ize_endings()
       word[j+1] = 'e';        /* try removing -ize and adding -e */
       word[j+2] = '\0';
       k = j+1;
-      if (search_hash(dict_ht, word) != NULL)
+      if (lookup(word) != NULL)
          return;
       word[j+1] = 'i';
       word[j+2] = 'z';
@@ -1110,13 +1663,13 @@ static void ment_endings()
 {
   int old_k = k;
 
-  if (search_hash(dict_ht, word) != NULL)
+  if (lookup(word) != NULL)
       return;
 
   if (ends_in("ment"))  {
      word[j+1] = '\0';
      k = j;
-     if (search_hash(dict_ht, word) != NULL)
+     if (lookup(word) != NULL)
         return;
      word[j+1] = 'm';
      k = old_k;
@@ -1136,18 +1689,18 @@ static void ity_endings()
 {
   int old_k = k;
 
-  if (search_hash(dict_ht, word) != NULL)
+  if (lookup(word) != NULL)
       return;
 
   if (ends_in("ity"))  {
      word[j+1] = '\0';             /* try just removing -ity */
      k = j;
-     if (search_hash(dict_ht, word) != NULL)
+     if (lookup(word) != NULL)
         return;
      word[j+1] = 'e';              /* try removing -ity and adding -e */
      word[j+2] = '\0';
      k = j+1;
-     if (search_hash(dict_ht, word) != NULL)
+     if (lookup(word) != NULL)
         return;
      word[j+1] = 'i';
      word[j+2] = 't';
@@ -1184,7 +1737,7 @@ static void ity_endings()
        the root form are in the dictionary, then remove the ending
        as a default */
 
-    if (search_hash(dict_ht, word) != NULL)   
+    if (lookup(word) != NULL)   
        return;
 
     /* the default is to remove -ity altogether */
@@ -1204,7 +1757,7 @@ static void ble_endings()
   int old_k = k;
   char word_char;
 
-  if (search_hash(dict_ht, word) != NULL)
+  if (lookup(word) != NULL)
      return;
 
   if (ends_in("ble"))  {
@@ -1214,12 +1767,12 @@ static void ble_endings()
      word_char = word[j];
      word[j] = '\0';             /* try just removing the ending */
      k = j-1;
-     if (search_hash(dict_ht, word) != NULL) 
+     if (lookup(word) != NULL) 
         return;
      if (doublec(k))  {          /* allow for a doubled consonant */
         word[k] = '\0';
         k--;
-        if (search_hash(dict_ht, word) != NULL)
+        if (lookup(word) != NULL)
            return;
         k++;
         word[k] = word[k-1];
@@ -1227,7 +1780,7 @@ static void ble_endings()
      word[j] = 'e';              /* try removing -a/ible and adding -e */
      word[j+1] = '\0';
      k = j;
-     if (search_hash(dict_ht, word) != NULL)
+     if (lookup(word) != NULL)
         return;
 
      word[j] = 'a';              /* try removing -able and adding -ate */
@@ -1235,7 +1788,7 @@ static void ble_endings()
      word[j+2] = 'e';
      word[j+3] = '\0';
      k = j+2;
-     if (search_hash(dict_ht, word) != NULL)
+     if (lookup(word) != NULL)
         return;
 
      word[j] = word_char;        /* restore the original values */
@@ -1254,7 +1807,7 @@ static void ble_endings()
 static void ness_endings() 
 {
 
-  if (search_hash(dict_ht, word) != NULL)
+  if (lookup(word) != NULL)
      return;
 
    if (ends_in("ness"))  {     /* this is a very productive endings, so just accept it */
@@ -1273,7 +1826,7 @@ static void ness_endings()
 static void ism_endings()
 {
 
-   if (search_hash(dict_ht, word) != NULL)
+   if (lookup(word) != NULL)
       return;
 
    if (ends_in("ism"))  {    /* this is a very productive ending, so just accept it */
@@ -1292,7 +1845,7 @@ static void ism_endings()
 static void ic_endings()
 {
 
-    if (search_hash(dict_ht, word) != NULL)
+    if (lookup(word) != NULL)
        return;
 
     if (ends_in("ic")) {
@@ -1300,22 +1853,22 @@ static void ic_endings()
        word[j+4] = 'l';
        word[j+5] = '\0';
        k = j+4;
-       if (search_hash(dict_ht, word) != NULL)
+       if (lookup(word) != NULL)
           return;
 
        word[j+1] = 'y';        /* try converting -ic to -y */
        word[j+2] = '\0';
        k = j+1;
-       if (search_hash(dict_ht, word) != NULL)
+       if (lookup(word) != NULL)
           return;
     
        word[j+1] = 'e';        /* try converting -ic to -e */
-       if (search_hash(dict_ht, word) != NULL)
+       if (lookup(word) != NULL)
           return;
 
        word[j+1] = '\0';       /* try removing -ic altogether */
        k = j;
-       if (search_hash(dict_ht, word) != NULL)
+       if (lookup(word) != NULL)
           return;
 
        word[j+1] = 'i';        /* restore the original ending */
@@ -1332,7 +1885,7 @@ static void ic_endings()
 
 static void ncy_endings()
 {
-  if (search_hash(dict_ht, word) != NULL)
+  if (lookup(word) != NULL)
       return;
 
    if (ends_in("ncy"))  {
@@ -1343,7 +1896,7 @@ static void ncy_endings()
       word[j+3] = '\0';         /* (e.g., constituency -> constituent) */
       k = j+2;
 
-      if (search_hash(dict_ht, word) != NULL)
+      if (lookup(word) != NULL)
          return;
 
       word[j+2] = 'c';          /* the default is to convert it to -nce */
@@ -1363,7 +1916,7 @@ static void nce_endings()
 
    char word_char;
 
-   if (search_hash(dict_ht, word) != NULL)
+   if (lookup(word) != NULL)
       return;
 
    if (ends_in("nce"))  {
@@ -1374,11 +1927,11 @@ static void nce_endings()
       word[j] = 'e';        /* try converting -e/ance to -e (adherance/adhere) */
       word[j+1] = '\0';
       k = j;
-      if (search_hash(dict_ht, word) != NULL)
+      if (lookup(word) != NULL)
          return;
       word[j] = '\0';       /* try removing -e/ance altogether (disappearance/disappear) */
       k = j-1;
-      if (search_hash(dict_ht, word) != NULL)
+      if (lookup(word) != NULL)
          return;
       word[j] = word_char;  /* restore the original ending */
       word[j+1] = 'n';
@@ -1390,15 +1943,24 @@ static void nce_endings()
 
 
 
-void stem(char *term, char *stem)
+/* stem_word() is instantiated once for each profile (see
+   kstem_set_profile()): families says which families of derivational
+   endings it tries, and the tests of it are resolved at compile time.  A
+   profile that is neither full nor inflectional only runs the families in
+   the calling thread's chain of routines (PROFILE_CHAIN). */
+
+#define PROFILE_CHAIN 0x80000000u
+
+static __thread void (*profile_chain[16])();      /* the families of a custom profile, in order */
+
+static __thread unsigned int profile_chain_length = 0;
+
+template <unsigned int families>
+static void stem_word(char *term, char *stem)
 {
+    unsigned int f;
     int i;
 
-    if (!dict_initialized_flag) {
-      printf("Error!  Dictionary was not initialized.\n              A call to read_dict_info() must be made before calling the stemmer.\n");
-      exit(1);
-      }
-
     word = stem;
 
     k = strlen((char *)term) - 1;
@@ -1412,9 +1974,12 @@ void stem(char *term, char *stem)
     /* if the string is not entirely alphabetic, then just return it
        as the stem */
 
+    prefix_len = 0;
     for (i=0; i<=k; i++)          
       if (!isalpha(word[i]))
          return;
+    if (dict_trie)
+       walk_trie();
 
 
     /* the basic algorithm is to check the dictionary, and leave the word as it
@@ -1429,10 +1994,10 @@ void stem(char *term, char *stem)
 
 
     /* try for a direct mapping  (this allows for cases like `Italian'->`Italy') */
-    lookup_value = search_hash(dict_ht, word);
+    lookup_value = lookup(word);
     if (lookup_value != NULL) {
        dep = (dictentry *)lookup_value;             /* if the root is "", then the result is */
-       if (dep->root != "") {                       /* the word itself (which was simply shifted */
+       if (dep->root[0] != '\0') {                       /* the word itself (which was simply shifted */
           strcpy((char *)stem, (char *)dep->root);  /* to lowercase at the beginning of the  */
           return;                                   /* routine). */
           } 
@@ -1444,37 +2009,647 @@ void stem(char *term, char *stem)
 
    
     /* try again for a direct mapping (this allows cases like `Italians'->`Italy') */
-   lookup_value = search_hash(dict_ht, word);
+   lookup_value = lookup(word);
     if (lookup_value != NULL)  {
        dep = (dictentry *)lookup_value;             /* if the root is "", then the result is */
-       if (dep->root != "")  {                      /* the word itself (which was simply shifted */
+       if (dep->root[0] != '\0')  {                      /* the word itself (which was simply shifted */
          strcpy((char *)stem, (char *)dep->root);   /* to lowercase at the beginning of the */
          return;                                    /* routine). */
           }
         }
 
-    ity_endings();
-    ness_endings();
-    ion_endings();
-    er_and_or_endings();
-    ly_endings();
-    al_endings();
-    ive_endings();
-    ize_endings();
-    ment_endings();
-    ble_endings();
-    ism_endings();
-    ic_endings();
-    ncy_endings();
-    nce_endings();
+    if (families & KSTEM_ITY)
+       ity_endings();
+    if (families & KSTEM_NESS)
+       ness_endings();
+    if (families & KSTEM_ION)
+       ion_endings();
+    if (families & KSTEM_ER)
+       er_and_or_endings();
+    if (families & KSTEM_LY)
+       ly_endings();
+    if (families & KSTEM_AL)
+       al_endings();
+    if (families & KSTEM_IVE)
+       ive_endings();
+    if (families & KSTEM_IZE)
+       ize_endings();
+    if (families & KSTEM_MENT)
+       ment_endings();
+    if (families & KSTEM_BLE)
+       ble_endings();
+    if (families & KSTEM_ISM)
+       ism_endings();
+    if (families & KSTEM_IC)
+       ic_endings();
+    if (families & KSTEM_NCY)
+       ncy_endings();
+    if (families & KSTEM_NCE)
+       nce_endings();
+    if (families & PROFILE_CHAIN)
+       for (f = 0; f < profile_chain_length; f++)
+          profile_chain[f]();
     
     /* for the last time, try for a direct mapping */
-    lookup_value = search_hash(dict_ht, word);
+    lookup_value = lookup(word);
     if (lookup_value != NULL)  {              /* if we now have a word in the dictionary, */
        dep = (dictentry *)lookup_value;       /* see if we can convert it to another form  */
-       if (dep->root != "")
+       if (dep->root[0] != '\0')
           strcpy((char *)stem, (char *)dep->root);
        }
 }
 
 
+
+/* Profiles.  The derivational families, in the order stem_word() tries
+   them, with the names kstem_parse_profile() knows them by. */
+
+static const struct
+    {
+    const char *name;
+    unsigned int family;
+    void (*endings)();
+   } families[] = {
+      { "ity", KSTEM_ITY, ity_endings },
+      { "ness", KSTEM_NESS, ness_endings },
+      { "ion", KSTEM_ION, ion_endings },
+      { "er", KSTEM_ER, er_and_or_endings },
+      { "ly", KSTEM_LY, ly_endings },
+      { "al", KSTEM_AL, al_endings },
+      { "ive", KSTEM_IVE, ive_endings },
+      { "ize", KSTEM_IZE, ize_endings },
+      { "ment", KSTEM_MENT, ment_endings },
+      { "ble", KSTEM_BLE, ble_endings },
+      { "ism", KSTEM_ISM, ism_endings },
+      { "ic", KSTEM_IC, ic_endings },
+      { "ncy", KSTEM_NCY, ncy_endings },
+      { "nce", KSTEM_NCE, nce_endings },
+      { NULL, 0, NULL } };
+
+static __thread void (*profile)(char *term, char *stem) = stem_word<KSTEM_FULL>;
+
+
+/* kstem_set_profile() chooses, for the calling thread, which families of
+   derivational endings stem() removes: KSTEM_FULL (the default), 
+   KSTEM_INFLECTIONAL (none: only plurals, past tenses and -ing), or any
+   combination of the KSTEM_ITY ... KSTEM_NCE bits.  Returns -1 if families
+   has bits that aren't families. */
+
+int kstem_set_profile(unsigned int families_wanted)
+{
+   unsigned int f;
+
+   if (families_wanted & ~KSTEM_FULL)
+      return -1;
+   if (families_wanted == KSTEM_FULL)
+      profile = stem_word<KSTEM_FULL>;
+   else if (families_wanted == KSTEM_INFLECTIONAL)
+      profile = stem_word<KSTEM_INFLECTIONAL>;
+   else  {
+      profile_chain_length = 0;
+      for (f = 0; families[f].name != NULL; f++)
+         if (families_wanted & families[f].family)
+            profile_chain[profile_chain_length++] = families[f].endings;
+      profile = stem_word<PROFILE_CHAIN>;
+      }
+   return 0;
+}
+
+/* the families named by spec: "full", "inflectional", or a list of family
+   names separated by commas ("ity,ness,ly").  Returns -1 if a name isn't
+   known. */
+
+int kstem_parse_profile(const char *spec)
+{
+   const char *p = spec, *end;
+   unsigned int wanted = 0, f;
+
+   if (strcmp(spec, "full") == 0)
+      return KSTEM_FULL;
+   if (strcmp(spec, "inflectional") == 0)
+      return KSTEM_INFLECTIONAL;
+   while (*p)  {
+      end = strchr(p, ',');
+      if (!end)
+         end = p + strlen(p);
+      for (f = 0; families[f].name != NULL; f++)
+         if (strlen(families[f].name) == (size_t)(end - p) && strncmp(families[f].name, p, end - p) == 0)
+            break;
+      if (families[f].name == NULL)
+         return -1;
+      wanted |= families[f].family;
+      p = *end ? end + 1 : end;
+      }
+   return wanted;
+}
+
+
+
+/* Fast paths.  Most of running text is a small number of very frequent
+   words ("the", "of", "was", ...), and short words that the rules leave
+   alone, yet each would go through the whole of stem().  So before anything
+   else, stem() looks for the term in two small tables of stems worked out
+   in advance: hot_words[], generated at build time from a frequency list
+   (see hot-words.h), and short_stems[], every word of one or two lower-case
+   letters.  Neither costs anything at load time.  The first time a word of
+   either table comes up, it is stemmed the usual way (see learn_fast_path());
+   that fills in its entry of short_stems[], and checks its entry of
+   hot_words[], which is only used from then on if the stems agree, since
+   the lexicon may not be the one it was built with.  Both tables are
+   bypassed by a thread with an overlay or a profile other than the full
+   one, and abandoned for good once the dictionary is changed at run time. */
+
+#define HOT_UNCHECKED 0
+#define HOT_AGREES    1
+#define HOT_DIFFERS   2
+
+static const char stem_too_long[HOT_LENGTH] = { '\0', 1 };   /* a short word whose stem won't fit */
+
+static int short_index(const char *term, size_t len)
+{
+   int i = 0;
+
+   for (; len > 0; len--, term++)  {
+      if (*term < 'a' || *term > 'z')
+         return -1;
+      i = i * 27 + (*term - 'a' + 1);
+      }
+   return i;
+}
+
+/* look for term in the tables.  If it belongs in one but its entry isn't
+   known yet, *short_at or *hot_at is set to the entry, for stem() to pass
+   to learn_fast_path() with the stem. */
+
+static inline boolean fast_stem(const char *term, char *stem, int *short_at, int *hot_at)
+{
+   size_t len = strnlen(term, HOT_LENGTH);
+   const char *found = NULL;
+   char known[HOT_LENGTH];
+   uint64_t key, entry;
+   unsigned int slot, n;
+   int i;
+
+   if (len <= 2)  {
+      if (len > 0 && (i = short_index(term, len)) >= 0)  {
+         entry = __atomic_load_n(&short_stems[i], __ATOMIC_RELAXED);
+         if (entry == 0)
+            *short_at = i;
+         else  {
+            memcpy(known, &entry, sizeof(known));
+            found = known;
+            }
+         }
+      }
+   else if (len < HOT_LENGTH)  {
+      key = hot_key(term, len);
+      slot = hot_hash(key, HOT_MULTIPLIER);
+      for (n = 0; n < HOT_PROBES; n++)  {
+         memcpy(&entry, hot_words[slot].word, sizeof(entry));
+         if (entry == key)  {
+            switch (__atomic_load_n(&hot_checked[slot], __ATOMIC_RELAXED))  {
+               case HOT_AGREES:    found = hot_words[slot].stem; break;
+               case HOT_UNCHECKED: *hot_at = slot; break;
+               }
+            break;
+            }
+         if (entry == 0)
+            break;
+         slot = (slot + 1) % HOT_SLOTS;
+         }
+      }
+   if (found == NULL || found[0] == '\0')
+      return FALSE;
+   strcpy(stem, found);
+   return TRUE;
+}
+
+/* record the stem of a word fast_stem() didn't know yet.  Several threads
+   may record the same entry at once, but they all record the same thing,
+   and an entry of short_stems[] is written with one store, so a reader
+   sees all of it or none of it. */
+
+static void learn_fast_path(int short_at, int hot_at, const char *thestem)
+{
+   uint64_t entry = 0;
+
+   if (short_at >= 0)  {
+      if (strlen(thestem) < HOT_LENGTH)
+         memcpy(&entry, thestem, strlen(thestem));
+      else
+         memcpy(&entry, stem_too_long, sizeof(entry));
+      __atomic_store_n(&short_stems[short_at], entry, __ATOMIC_RELAXED);
+      }
+   if (hot_at >= 0)
+      __atomic_store_n(&hot_checked[hot_at],
+                       (unsigned char)(strcmp(thestem, hot_words[hot_at].stem) == 0 ? HOT_AGREES : HOT_DIFFERS),
+                       __ATOMIC_RELAXED);
+}
+
+/* called once the dictionary is loaded; the entries are learned as the
+   words come up */
+
+static void prepare_fast_paths()
+{
+   memset(short_stems, 0, sizeof(short_stems));
+   memset(hot_checked, HOT_UNCHECKED, sizeof(hot_checked));
+   __atomic_store_n(&fast_ready, TRUE, __ATOMIC_RELEASE);
+}
+
+
+
+/* The stem cache.  With KSTEM_CACHE set to a number of entries, the stems of
+   the words stemmed are kept in a cache of that size, shared by every
+   thread, so a word seen again -- by any thread -- costs a lookup rather
+   than a run through the rules.  Like the fast paths, it serves only
+   threads with no overlay and the full profile, and an entry made before
+   the dictionary was changed while running is never used.
+
+   The cache is split into many small shards (CACHESET), each of CACHE_WAYS
+   entries, and a word can only be kept in the shard its hash picks.
+   Reading takes no lock: each entry has a sequence count, odd while it is
+   being written, and a reader that sees it change while copying the stem
+   treats the lookup as a miss.  A writer takes its shard's lock, or, if
+   another thread holds it, doesn't bother adding the stem at all.  When a
+   shard is full, the entry to replace is chosen by CLOCK: a hit marks the
+   entry, and the shard's hand passes over (and unmarks) marked entries
+   until it finds one that wasn't used since the hand last went by.
+   kstem_cache_stats() counts the hits and misses, and the contention (the
+   reads that raced with a writer, and the stems not added because the
+   shard was locked); the counts are kept by each thread, and added up
+   when asked for.
+
+   The cache can outlive the process.  kstem_cache_save() writes the stems
+   in the cache to a file, as a lexicon image (see lexicon.h) whose roots
+   are the stems and which is tagged with a checksum of the lexicon files.
+   kstem_cache_load() maps such a file -- as read_dict_info() does with
+   KSTEM_CACHE_SNAPSHOT -- and stem() looks there after the cache.  A file
+   made from other lexicon files is rejected. */
+
+#define CACHE_WAYS 8              /* the entries of a shard */
+#define CACHE_TEXT 48             /* room for a term and its stem, so an entry is 64 bytes */
+
+typedef struct
+{
+   unsigned int seq;              /* odd while the entry is being changed */
+   unsigned int hash;
+   unsigned int generation;       /* of the dictionary the stem was made with */
+   unsigned short term_len;       /* 0 if the entry is empty */
+   unsigned short stem_len;
+   char text[CACHE_TEXT];         /* the term and then its stem, without '\0's */
+} CACHEENTRY;
+
+typedef struct
+{
+   unsigned int hashes[CACHE_WAYS];       /* of the entries, to find a term without touching them */
+   unsigned char marked[CACHE_WAYS];      /* used since the hand passed */
+   unsigned char hand;
+   unsigned char lock;                    /* held while an entry is replaced */
+} __attribute__((aligned(64))) CACHESET;
+
+typedef struct stats
+{
+   KSTEM_CACHE_STATS counts;
+   struct stats *next, *prev;     /* every thread's counts */
+} STATS;
+
+static unsigned int cache_sets = 0;            /* the number of shards (0 without KSTEM_CACHE) */
+
+static CACHESET *cache_set;
+
+static CACHEENTRY *cache_entry;                /* CACHE_WAYS for each shard */
+
+static __thread STATS *stats = NULL;
+
+static STATS *all_stats = NULL;
+
+static KSTEM_CACHE_STATS finished_stats;       /* the counts of threads that have finished */
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;     /* guards the last two */
+
+static pthread_key_t stats_key;                /* gathers a thread's counts when it finishes */
+
+static LEXICON *snapshot = NULL;               /* the stems mapped by kstem_cache_load() */
+
+/* a counter only its own thread changes, but others read */
+#define count(field) __atomic_store_n(&stats->counts.field, stats->counts.field + 1, __ATOMIC_RELAXED)
+
+
+static void add_stats(KSTEM_CACHE_STATS *total, const KSTEM_CACHE_STATS *c)
+{
+   total->hits += __atomic_load_n(&c->hits, __ATOMIC_RELAXED);
+   total->misses += __atomic_load_n(&c->misses, __ATOMIC_RELAXED);
+   total->snapshot_hits += __atomic_load_n(&c->snapshot_hits, __ATOMIC_RELAXED);
+   total->raced_reads += __atomic_load_n(&c->raced_reads, __ATOMIC_RELAXED);
+   total->locked_out += __atomic_load_n(&c->locked_out, __ATOMIC_RELAXED);
+   total->evictions += __atomic_load_n(&c->evictions, __ATOMIC_RELAXED);
+}
+
+static void stats_destroy(void *arg)
+{
+   STATS *s = (STATS *)arg;
+
+   pthread_mutex_lock(&stats_lock);
+   if (s->prev)
+      s->prev->next = s->next;
+   else
+      all_stats = s->next;
+   if (s->next)
+      s->next->prev = s->prev;
+   add_stats(&finished_stats, &s->counts);
+   pthread_mutex_unlock(&stats_lock);
+   free(s);
+}
+
+static void stats_create()
+{
+   stats = (STATS *)calloc(1, sizeof(STATS));
+   pthread_mutex_lock(&stats_lock);
+   stats->next = all_stats;
+   if (all_stats)
+      all_stats->prev = stats;
+   all_stats = stats;
+   pthread_mutex_unlock(&stats_lock);
+   pthread_setspecific(stats_key, stats);
+}
+
+/* the counts so far, of every thread */
+
+void kstem_cache_stats(KSTEM_CACHE_STATS *total)
+{
+   STATS *s;
+
+   memset(total, 0, sizeof(*total));
+   pthread_mutex_lock(&stats_lock);
+   add_stats(total, &finished_stats);
+   for (s = all_stats; s; s = s->next)
+      add_stats(total, &s->counts);
+   pthread_mutex_unlock(&stats_lock);
+   total->entries = cache_sets * CACHE_WAYS;
+}
+
+
+/* add a consistent copy of e, if it is of the current generation, to lex.
+   A stem that is the term itself is kept as no root at all. */
+
+static void keep_entry(LEXICON *lex, const CACHEENTRY *e, unsigned int generation)
+{
+   CACHEENTRY copy;
+   unsigned int seq;
+   char term[CACHE_TEXT + 1], thestem[CACHE_TEXT + 1];
+
+   do  {
+      seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+      memcpy(&copy, e, sizeof(copy));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      } while ((seq & 1) || __atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq);
+   if (copy.term_len == 0 || copy.generation != generation || copy.term_len + copy.stem_len > CACHE_TEXT)
+      return;
+   memcpy(term, copy.text, copy.term_len);
+   term[copy.term_len] = '\0';
+   memcpy(thestem, copy.text + copy.term_len, copy.stem_len);
+   thestem[copy.stem_len] = '\0';
+   lex_add(lex, term, strcmp(term, thestem) == 0 ? "" : thestem, 0);
+}
+
+/* called once the dictionary is loaded */
+
+static void prepare_cache()
+{
+   const char *size = getenv("KSTEM_CACHE"), *path = getenv("KSTEM_CACHE_SNAPSHOT");
+   unsigned long n, entries;
+   int loaded;
+
+   if (size && (n = atol(size)) > 0 && cache_sets == 0)  {
+      for (entries = CACHE_WAYS; entries < n && entries < (1ul << 30); entries *= 2)
+         ;
+      cache_set = (CACHESET *)aligned_alloc(64, entries / CACHE_WAYS * sizeof(CACHESET));
+      memset(cache_set, 0, entries / CACHE_WAYS * sizeof(CACHESET));
+      cache_entry = (CACHEENTRY *)aligned_alloc(64, entries * sizeof(CACHEENTRY));
+      memset(cache_entry, 0, entries * sizeof(CACHEENTRY));
+      pthread_key_create(&stats_key, stats_destroy);
+      cache_sets = entries / CACHE_WAYS;
+      }
+   if (path)  {
+      loaded = kstem_cache_load(path);
+      if (getenv("KSTEM_TIMING"))  {
+         if (loaded >= 0)
+            fprintf(stderr, "kstem: mapped %d cached stems from %s\n", loaded, path);
+         else
+            fprintf(stderr, "kstem: %s is missing, or is for other lexicon files\n", path);
+         }
+      }
+}
+
+/* the stem of term (of length len) from the cache, if it is there.  *hash
+   (never 0, which marks an empty way) and *generation are set for
+   cache_add().  The generation is read before the caller loads the runtime
+   changes, so a change made in between can only make the stem it caches
+   look older than it is, never newer. */
+
+static boolean cache_find(const char *term, size_t len, unsigned int *hash, unsigned long *generation,
+                          char *stem)
+{
+   const LEXICON *snap = __atomic_load_n(&snapshot, __ATOMIC_ACQUIRE);
+   CACHESET *set;
+   const CACHEENTRY *e;
+   const LEXSLOT *s;
+   const char *root;
+   unsigned int w, seq;
+
+   *generation = __atomic_load_n(&dict_generation, __ATOMIC_ACQUIRE);
+   if (cache_sets)  {
+      if (stats == NULL)
+         stats_create();
+      if ((*hash = lex_hash(term)) == 0)
+         *hash = 1;
+      set = &cache_set[*hash & (cache_sets - 1)];
+      for (w = 0; w < CACHE_WAYS; w++)  {
+         if (__atomic_load_n(&set->hashes[w], __ATOMIC_RELAXED) != *hash)
+            continue;
+         e = &cache_entry[(*hash & (cache_sets - 1)) * CACHE_WAYS + w];
+         seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+         if (!(seq & 1) && e->hash == *hash && e->generation == (unsigned int)*generation &&
+             e->term_len == len && memcmp(e->text, term, len) == 0 && e->stem_len < kstem_stem_size(len))  {
+            memcpy(stem, e->text + len, e->stem_len);
+            stem[e->stem_len] = '\0';
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq)  {
+               if (!set->marked[w])
+                  __atomic_store_n(&set->marked[w], 1, __ATOMIC_RELAXED);
+               count(hits);
+               return TRUE;
+               }
+            }
+         if (seq & 1 || __atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq)
+            count(raced_reads);
+         }
+      count(misses);
+      }
+
+   /* the snapshot's stems are only right for the lexicon files as they are */
+   if (snap && *generation == 0 && (s = lex_find(snap, term)) != NULL)  {
+      root = snap->pool + s->root;
+      if (root[0] == '\0')
+         strcpy(stem, term);
+      else if (strlen(root) < kstem_stem_size(len))
+         strcpy(stem, root);
+      else
+         return FALSE;
+      if (cache_sets)
+         count(snapshot_hits);
+      return TRUE;
+      }
+   return FALSE;
+}
+
+/* cache the stem of term, made with the dictionary of the given generation */
+
+static void cache_add(const char *term, size_t len, unsigned int hash, unsigned long generation,
+                      const char *stem)
+{
+   CACHESET *set = &cache_set[hash & (cache_sets - 1)];
+   CACHEENTRY *e;
+   size_t stem_len = strlen(stem);
+   unsigned int w, seq;
+
+   if (len == 0 || len + stem_len > CACHE_TEXT)
+      return;
+   if (__atomic_test_and_set(&set->lock, __ATOMIC_ACQUIRE))  {
+      count(locked_out);
+      return;
+      }
+
+   /* an empty entry if there is one, or else the first the hand finds unmarked */
+   for (w = 0; w < CACHE_WAYS && set->hashes[w] != 0; w++)
+      ;
+   if (w == CACHE_WAYS)  {
+      while (set->marked[set->hand])  {
+         __atomic_store_n(&set->marked[set->hand], 0, __ATOMIC_RELAXED);
+         set->hand = (set->hand + 1) % CACHE_WAYS;
+         }
+      w = set->hand;
+      set->hand = (set->hand + 1) % CACHE_WAYS;
+      count(evictions);
+      }
+
+   e = &cache_entry[(hash & (cache_sets - 1)) * CACHE_WAYS + w];
+   seq = e->seq;
+   __atomic_store_n(&e->seq, seq + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+   e->hash = hash;
+   e->generation = (unsigned int)generation;
+   e->term_len = len;
+   e->stem_len = stem_len;
+   memcpy(e->text, term, len);
+   memcpy(e->text + len, stem, stem_len);
+   __atomic_store_n(&e->seq, seq + 2, __ATOMIC_RELEASE);
+   __atomic_store_n(&set->hashes[w], hash, __ATOMIC_RELAXED);
+   set->marked[w] = 0;
+   __atomic_clear(&set->lock, __ATOMIC_RELEASE);
+}
+
+
+/* map a snapshot of the cache written by kstem_cache_save().  Returns the
+   number of stems in it, or -1 if there is no such file, or if it was made
+   from other lexicon files.  A snapshot it replaces stays mapped, since
+   other threads may still be reading it. */
+
+int kstem_cache_load(const char *path)
+{
+   const char *stemdir = getenv("STEM_DIR");
+   LEXICON *snap;
+
+   if (!dict_initialized_flag || !stemdir)
+      return -1;
+   snap = lex_file_attach(path, lex_checksum(stemdir));
+   if (snap == NULL)
+      return -1;
+   __atomic_store_n(&snapshot, snap, __ATOMIC_RELEASE);
+   return snap->nentries;
+}
+
+/* write every stem in the cache (and in the snapshot in use) to path.
+   Returns the number written, or -1 if it couldn't be written -- or if the
+   dictionary has been changed while running, since the stems would then
+   not be those of the lexicon files. */
+
+int kstem_cache_save(const char *path)
+{
+   const char *stemdir = getenv("STEM_DIR");
+   LEXICON *lex, *snap = __atomic_load_n(&snapshot, __ATOMIC_ACQUIRE);
+   unsigned long i;
+   int n;
+
+   if (!dict_initialized_flag || !stemdir || kstem_dictionary_generation() != 0)
+      return -1;
+   lex = lex_create(0, 0);
+   for (i = 0; i < (unsigned long)cache_sets * CACHE_WAYS; i++)
+      keep_entry(lex, &cache_entry[i], 0);
+   if (snap)
+      for (i = 0; i < snap->nslots; i++)
+         if (snap->slots[i].key != 0)
+            lex_add(lex, snap->pool + snap->slots[i].key, snap->pool + snap->slots[i].root, 0);
+
+   n = lex->nentries;
+   if (kstem_dictionary_generation() != 0 || lex_file_save(path, lex, lex_checksum(stemdir)) != 0)
+      n = -1;
+   lex_free(lex);
+   return n;
+}
+
+
+
+/* stem() is the entry point.  The runtime changes to the dictionary are
+   read without a lock: the version current when the call starts is used
+   for the whole call, and it won't be freed until the call returns. */
+
+void stem(char *term, char *stem)
+{
+    size_t need, len;
+    unsigned int hash = 0;
+    unsigned long generation = 0;
+    boolean caching = FALSE;
+    int short_at = -1, hot_at = -1;
+
+    if (__atomic_load_n(&fast_ready, __ATOMIC_RELAXED) && overlay == NULL &&
+        profile == stem_word<KSTEM_FULL> && fast_stem(term, stem, &short_at, &hot_at))
+       return;
+
+    if (!dict_initialized_flag) {
+      printf("Error!  Dictionary was not initialized.\n              A call to read_dict_info() must be made before calling the stemmer.\n");
+      exit(1);
+      }
+
+    if (replicas == NULL)
+       home_dict = dict;
+    else if (home_calls++ % HOME_CHECK == 0)
+       home_dict = local_replica();
+
+    len = strlen(term);
+    if ((cache_sets || snapshot) && overlay == NULL && profile == stem_word<KSTEM_FULL>)  {
+       if (cache_find(term, len, &hash, &generation, stem))
+          return;
+       caching = cache_sets != 0;
+       }
+
+    /* the rules work on a padded copy of the word (see ends()).  It is
+       sized after the changes are loaded: change_dictionary() notes a new
+       root before it publishes the changes that hold it, so the size
+       allows for every root of this version of them. */
+    rcu_read_lock();
+    live = __atomic_load_n(&runtime_changes, __ATOMIC_ACQUIRE);
+    need = kstem_stem_size(len) + WORD_PAD;
+    if (need > work_size)  {
+       work = (char *)realloc(work, need);
+       memset(work + work_size, 0, need - work_size);
+       work_size = need;
+       }
+    profile(term, work);
+    rcu_read_unlock();
+    strcpy(stem, work);
+    if (short_at >= 0 || hot_at >= 0)
+       learn_fast_path(short_at, hot_at, work);
+    if (caching)
+       cache_add(term, len, hash, generation, work);
+}
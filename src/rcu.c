@@ -0,0 +1,104 @@
+/*
+ * Quiescent-state reclamation (see rcu.h).
+ *
+ * Every thread that reads gets a READER record with a counter that is odd
+ * while the thread is inside a read-side section.  rcu_synchronize() waits
+ * for each counter that is odd to change, which means that reader has left
+ * the section it was in when the new version was published.
+ */
+
+
+#include <stdlib.h>
+#include <sched.h>
+#include <pthread.h>
+#include "rcu.h"
+
+typedef struct reader
+{
+  unsigned long ctr;           /* odd while the thread is reading */
+  int in_use;                  /* cleared when the thread exits, so the record can be reused */
+  struct reader *next;
+} READER;
+
+
+static READER *readers = NULL;
+static pthread_mutex_t readers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t reader_key;
+static pthread_once_t reader_once = PTHREAD_ONCE_INIT;
+
+static __thread READER *me = NULL;
+
+
+static void release_reader(void *arg)
+{
+  READER *r = (READER *)arg;
+
+  __atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void make_key()
+{
+  pthread_key_create(&reader_key, release_reader);
+}
+
+
+/*
+ * Give the calling thread a record, reusing one left by a thread that exited
+ */
+
+static void register_reader()
+{
+  READER *r;
+
+  pthread_once(&reader_once, make_key);
+  pthread_mutex_lock(&readers_lock);
+  for (r = readers; r != NULL; r = r->next)
+    if (!r->in_use)
+      break;
+  if (r == NULL)
+    {
+      r = (READER *)calloc(1, sizeof(READER));
+      r->next = readers;
+      readers = r;
+    }
+  r->in_use = 1;
+  pthread_mutex_unlock(&readers_lock);
+  pthread_setspecific(reader_key, r);
+  me = r;
+}
+
+
+void rcu_read_lock()
+{
+  if (me == NULL)
+    register_reader();
+  /* the store must be visible before any shared pointer is loaded */
+  __atomic_store_n(&me->ctr, me->ctr + 1, __ATOMIC_SEQ_CST);
+}
+
+void rcu_read_unlock()
+{
+  __atomic_store_n(&me->ctr, me->ctr + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Wait until every reader that was inside a read-side section has left it
+ */
+
+void rcu_synchronize()
+{
+  READER *r;
+  unsigned long c;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  pthread_mutex_lock(&readers_lock);
+  for (r = readers; r != NULL; r = r->next)
+    {
+      c = __atomic_load_n(&r->ctr, __ATOMIC_ACQUIRE);
+      if (c & 1)
+	while (__atomic_load_n(&r->ctr, __ATOMIC_ACQUIRE) == c)
+	  sched_yield();
+    }
+  pthread_mutex_unlock(&readers_lock);
+}
@@ -0,0 +1,13 @@
+/*
+ * Quiescent-state reclamation for data that is read without locks.
+ *
+ * Readers bracket each use of shared data with rcu_read_lock() and
+ * rcu_read_unlock(), which only write to a counter owned by the calling
+ * thread.  A writer publishes a new version of the data with an atomic
+ * pointer store, calls rcu_synchronize() to wait until every reader that
+ * might still see the old version has finished, and then frees it.
+ */
+
+void rcu_read_lock();
+void rcu_read_unlock();
+void rcu_synchronize();
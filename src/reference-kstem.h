@@ -0,0 +1,15 @@
+/*
+ * reference-kstem.h - the frozen reference stemmer (see reference-kstem.c),
+ *                     used only to check the real one.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ref_read_dict_info();
+void ref_stem(char *term, char *stem);
+
+#ifdef __cplusplus
+}
+#endif
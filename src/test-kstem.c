@@ -1,8 +1,6 @@
 #include <stdio.h>
-
-/* Function prototypes */
-void read_dict_info();
-void stem(char *, char *);
+#include <string.h>
+#include "kstem.h"
 
 int main () {
 
@@ -13,7 +11,8 @@ int main () {
 
    do  {
       printf("Please enter a word (<CR> to quit): ");
-      gets(word);
+      if (fgets(word, sizeof(word), stdin) == NULL) break;
+      word[strcspn(word, "\r\n")] = '\0';
       if (*word == '\0') break;
 
       stem(word, thestem);
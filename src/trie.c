@@ -0,0 +1,231 @@
+/*
+ * Double-array tries over lexicons (see trie.h).
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "lexicon.h"
+#include "trie.h"
+
+#define FREE (-1)
+
+
+typedef struct
+{
+  const char *key;
+  unsigned int slot;
+} TRIEWORD;
+
+/* the trie being built */
+typedef struct
+{
+  LEXTRIE *t;
+  TRIEWORD *words;
+  unsigned int cap;            /* cells allocated */
+  unsigned int *next, *prev;   /* the free cells, as a list in increasing order */
+  unsigned int head, tail;     /* (0, the root, is never free, so it ends the list) */
+  int max_base;
+} BUILD;
+
+
+static int by_key(const void *a, const void *b)
+{
+  return strcmp(((const TRIEWORD *)a)->key, ((const TRIEWORD *)b)->key);
+}
+
+/* make sure cells [0, n) exist */
+
+static void reserve(BUILD *b, unsigned int n)
+{
+  unsigned int i;
+
+  if (n <= b->cap)
+    return;
+  i = b->cap;
+  while (b->cap < n)
+    b->cap = b->cap ? 2 * b->cap : 1024;
+  b->t->cells = (TRIECELL *)realloc(b->t->cells, b->cap * sizeof(TRIECELL));
+  b->next = (unsigned int *)realloc(b->next, b->cap * sizeof(unsigned int));
+  b->prev = (unsigned int *)realloc(b->prev, b->cap * sizeof(unsigned int));
+  for (; i < b->cap; i++)
+    {
+      b->t->cells[i].base = 0;
+      b->t->cells[i].check = FREE;
+      b->t->cells[i].slot = 0;
+      if (i == 0)
+	continue;
+      b->prev[i] = b->tail;
+      b->next[i] = 0;
+      if (b->tail)
+	b->next[b->tail] = i;
+      else
+	b->head = i;
+      b->tail = i;
+    }
+}
+
+static void take(BUILD *b, unsigned int i, int parent)
+{
+  b->t->cells[i].check = parent;
+  if (b->prev[i])
+    b->next[b->prev[i]] = b->next[i];
+  else
+    b->head = b->next[i];
+  if (b->next[i])
+    b->prev[b->next[i]] = b->prev[i];
+  else
+    b->tail = b->prev[i];
+}
+
+/* the lowest base at which the cells for every one of labels[0..n) are
+   free (labels are in increasing order) */
+
+static int find_base(BUILD *b, const unsigned char *labels, int n)
+{
+  unsigned int pos, last;
+  int base, i;
+
+  /* only the free cells are tried for the first label */
+  for (pos = b->head; ; pos = b->next[pos])
+    {
+      if (pos == 0)
+	{
+	  last = b->tail;
+	  reserve(b, b->cap + 1);
+	  pos = last ? b->next[last] : b->head;
+	}
+      if (pos <= labels[0])
+	continue;
+      base = pos - labels[0];
+      reserve(b, base + 257);
+      for (i = 1; i < n && b->t->cells[base + labels[i]].check == FREE; i++)
+	;
+      if (i == n)
+	return base;
+    }
+}
+
+/* add the words [lo, hi), which share their first depth bytes and lead to
+   state, below state */
+
+static void build(BUILD *b, unsigned int lo, unsigned int hi, unsigned int depth, int state)
+{
+  unsigned char labels[256];
+  unsigned int starts[257], w = lo;
+  int n = 0, i, base;
+
+  /* in sorted order, the word that ends here comes first */
+  if (w < hi && b->words[w].key[depth] == '\0')
+    b->t->cells[state].slot = b->words[w++].slot + 1;
+  while (w < hi)
+    {
+      labels[n] = (unsigned char)b->words[w].key[depth];
+      starts[n++] = w;
+      while (w < hi && (unsigned char)b->words[w].key[depth] == labels[n - 1])
+	w++;
+    }
+  starts[n] = hi;
+  if (n == 0)
+    return;
+
+  base = find_base(b, labels, n);
+  b->t->cells[state].base = base;
+  if (base > b->max_base)
+    b->max_base = base;
+  for (i = 0; i < n; i++)
+    take(b, base + labels[i], state);
+  b->t->nstates += n;
+
+  for (i = 0; i < n; i++)
+    build(b, starts[i], starts[i + 1], depth + 1, base + labels[i]);
+}
+
+
+/*
+ * Build a trie over every word of lex.  The trie refers to lex's slots by
+ * their index, so it stays valid as long as lex (or a copy of it) does.
+ */
+
+LEXTRIE *trie_build(const LEXICON *lex)
+{
+  BUILD b;
+  unsigned int i, n = 0;
+
+  memset(&b, 0, sizeof(b));
+  b.t = (LEXTRIE *)calloc(1, sizeof(LEXTRIE));
+  b.words = (TRIEWORD *)malloc((lex->nentries + 1) * sizeof(TRIEWORD));
+  for (i = 0; i < lex->nslots; i++)
+    if (lex->slots[i].key != 0)
+      {
+	b.words[n].key = lex->pool + lex->slots[i].key;
+	b.words[n++].slot = i;
+      }
+  qsort(b.words, n, sizeof(TRIEWORD), by_key);
+
+  reserve(&b, 257);
+  b.t->cells[0].check = 0;       /* the root */
+  b.t->nstates = 1;
+  build(&b, 0, n, 0, 0);
+  free(b.words);
+  free(b.next);
+  free(b.prev);
+
+  /* keep room for base + any byte, so a walk needs no bounds check */
+  b.t->ncells = b.max_base + 256;
+  b.t->cells = (TRIECELL *)realloc(b.t->cells, b.t->ncells * sizeof(TRIECELL));
+  return b.t;
+}
+
+void trie_free(LEXTRIE *t)
+{
+  free(t->cells);
+  free(t);
+}
+
+
+/*
+ * 1 + the slot of key in the lexicon, or 0 if key isn't a word
+ */
+
+unsigned int trie_find(const LEXTRIE *t, const char *key)
+{
+  const TRIECELL *cells = t->cells;
+  int s = 0, next;
+
+  for (; *key; key++)
+    {
+      next = cells[s].base + (unsigned char)*key;
+      if (cells[next].check != s)
+	return 0;
+      s = next;
+    }
+  return cells[s].slot;
+}
+
+/*
+ * Walk key once, and set slots[n] to 1 + the slot of its first n bytes, or
+ * 0 if they aren't a word, for every n up to the length of key or max.
+ * Returns the largest n set.
+ */
+
+unsigned int trie_prefixes(const LEXTRIE *t, const char *key, unsigned int *slots, unsigned int max)
+{
+  const TRIECELL *cells = t->cells;
+  unsigned int n;
+  int s = 0, next;
+
+  slots[0] = 0;
+  for (n = 0; n < max && key[n]; n++)
+    {
+      next = cells[s].base + (unsigned char)key[n];
+      if (cells[next].check != s)
+	break;
+      s = next;
+      slots[n + 1] = cells[s].slot;
+    }
+  /* no longer prefix can be a word */
+  for (; n < max && key[n]; n++)
+    slots[n + 1] = 0;
+  return n;
+}
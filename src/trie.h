@@ -0,0 +1,36 @@
+/*
+ * A double-array trie over the words of a LEXICON.
+ *
+ * Each state is a cell of one array.  The transition from state s on byte c
+ * goes to cell base(s) + c, and is valid only if that cell's check is s, so
+ * walking a word costs one array access per letter and no string
+ * comparisons.  A cell where a dictionary word ends holds the index of the
+ * word's slot in the lexicon (plus one), which gives its flags and root.
+ *
+ * Since a walk passes through every prefix of the word, trie_prefixes()
+ * answers "is this prefix a word?" for all of them at once -- the question
+ * the stemmer's rules ask again and again as they strip suffixes.
+ *
+ * The slot indexes are the same in any copy of the lexicon made by
+ * lex_replicate(), so one trie serves them all.
+ */
+
+typedef struct
+{
+  int base;                    /* children are at base + byte */
+  int check;                   /* the parent state, or -1 if the cell is free */
+  unsigned int slot;           /* 1 + the slot of the word ending here, or 0 */
+} TRIECELL;
+
+typedef struct
+{
+  TRIECELL *cells;
+  unsigned int ncells;
+  unsigned int nstates;
+} LEXTRIE;
+
+
+LEXTRIE *trie_build(const LEXICON *lex);
+void trie_free(LEXTRIE *t);
+unsigned int trie_find(const LEXTRIE *t, const char *key);
+unsigned int trie_prefixes(const LEXTRIE *t, const char *key, unsigned int *slots, unsigned int max);
@@ -0,0 +1,510 @@
+/*
+   verify-kstem - check that the stemmer returns exactly what the reference
+                  stemmer (reference-kstem.c, a frozen copy of version 0.8)
+                  returns.
+
+   Three sets of words are stemmed by both, and every difference is reported:
+
+      lexicon      every word in the lexicon files (roots included), as is
+                   and capitalized
+      inflections  every headword with each of the endings the rules know
+                   about, including the doubled-consonant, dropped-e and
+                   y-to-i spellings
+      fuzz         random tokens: strings of letters with the common
+                   endings, lexicon words with a letter changed, added or
+                   removed, and tokens with digits, punctuation, upper case,
+                   bytes above 127, and long runs of letters
+
+   Then a text with every kind of white space in it (form feeds and
+   vertical tabs included) is split into tokens by kstem_spans() and by a
+   stream, which must find the words it was made from.
+
+   The fuzz tokens are a function of the seed and their number alone, so a
+   failure can be reproduced with -s whatever the number of threads.  The
+   words are divided among the threads, each of which compares every engine
+   in the engines[] table below against the reference.
+
+   usage:  verify-kstem [-t threads] [-n fuzz-tokens] [-s seed]
+
+   The exit status is 1 if anything differed.  "make verify" runs it.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "kstem.h"
+#include "kstem-analyzer.h"
+#include "reference-kstem.h"
+
+#define DEFAULT_FUZZ 2000000
+#define MAX_THREADS 256
+#define MAX_REPORTED 20           /* differences printed in full */
+#define MAX_FUZZ_LENGTH 300
+
+
+/* The engines checked against the reference.  Each is called the way
+   stem() is: the caller provides storage for the stem. */
+
+typedef struct
+{
+   const char *name;
+   void (*run)(char *term, char *stem);
+} ENGINE;
+
+/* stem() twice: with KSTEM_CACHE set, the second stem comes from the cache */
+static void stem_cached(char *term, char *thestem)
+{
+   stem(term, thestem);
+   stem(term, thestem);
+}
+
+/* the word fed to an analyzer in three pieces, so it has to be put back
+   together (a word with a separator in it is several tokens, so it is
+   stemmed as is) */
+static void stem_streamed(char *term, char *thestem)
+{
+   static thread_local kstem::Analyzer analyzer;
+   size_t len = strlen(term), n = 0;
+   auto keep = [&](const KSTEM_SPAN &t) { memcpy(thestem, t.stem, t.stem_length + 1); n++; };
+
+   if (strpbrk(term, " \t\r\n\f\v") || len == 0)  {
+      stem(term, thestem);
+      return;
+      }
+   analyzer.feed(term, len / 3, keep);
+   analyzer.feed(term + len / 3, len - len / 3 - len / 2, keep);
+   for (const KSTEM_SPAN &t : analyzer.tokens(term + len - len / 2, len / 2))
+      keep(t);
+   analyzer.finish(keep);
+   if (n != 1)
+      strcpy(thestem, "(not one token)");
+}
+
+static ENGINE engines[] = {
+   { "stem", stem },
+   { "cached", stem_cached },
+   { "streamed", stem_streamed },
+   { NULL, NULL } };
+
+
+/* the endings tried on every headword, and on the fuzz tokens */
+static const char *endings[] = {
+   "s", "es", "ies", "'s", "s'", "ed", "ied", "ing", "ings", "er", "ers", "est",
+   "or", "ors", "ly", "ily", "ally", "al", "ial", "ical", "ically",
+   "ive", "ives", "ative", "ively", "ize", "izes", "ized", "izing", "ization",
+   "izations", "izer", "ise", "ment", "ments", "ity", "ities", "ability",
+   "ibility", "ness", "iness", "nesses", "ism", "isms", "ist", "ic", "ics",
+   "ency", "ancy", "encies", "ence", "ance", "ences", "ation", "ations",
+   "ition", "ication", "ion", "ions", "able", "ible", "ably", "ibly", "ful",
+   "less", "ous", "y", "e", NULL };
+
+enum { LEXICON_SET, INFLECTION_SET, FUZZ_SET, NUM_SETS };
+static const char *set_names[NUM_SETS] = { "lexicon", "inflections", "fuzz" };
+
+
+typedef struct
+{
+   char *text;             /* the words, each followed by a '\0' */
+   size_t size, cap;
+   size_t *offsets;
+   unsigned int n, ncap;
+} WORDS;
+
+typedef struct
+{
+   int id, nthreads;
+   unsigned long compared[NUM_SETS];
+   unsigned long differed[NUM_SETS];
+} WORKER;
+
+
+static WORDS sets[NUM_SETS - 1];         /* the lexicon and inflection sets */
+static WORDS headwords;
+static unsigned long nfuzz = DEFAULT_FUZZ;
+static unsigned long long seed = 1;
+static size_t longest_root = 0;
+
+static pthread_mutex_t report_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long reported = 0;
+
+
+static double now_ms()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+
+static void add_word(WORDS *s, const char *w, size_t len)
+{
+   if (s->size + len + 1 > s->cap)  {
+      s->cap = (s->size + len + 1) * 2;
+      s->text = (char *)realloc(s->text, s->cap);
+      }
+   if (s->n == s->ncap)  {
+      s->ncap = s->ncap ? s->ncap * 2 : 1024;
+      s->offsets = (size_t *)realloc(s->offsets, s->ncap * sizeof(size_t));
+      }
+   s->offsets[s->n++] = s->size;
+   memcpy(s->text + s->size, w, len);
+   s->size += len;
+   s->text[s->size++] = '\0';
+}
+
+static void add_string(WORDS *s, const char *w)
+{
+   add_word(s, w, strlen(w));
+}
+
+
+/* add the words of one lexicon file to the lexicon set (and, for the files
+   of words, to the headwords the inflections are made from) */
+
+static void read_words(const char *stemdir, const char *name, int pairs)
+{
+   char *path, *w, *cap;
+   FILE *f;
+   unsigned int n = 0;
+
+   path = (char *)malloc(strlen(stemdir) + strlen(name) + 2);
+   sprintf(path, "%s/%s", stemdir, name);
+   f = fopen(path, "r");
+   if (!f)  {
+      fprintf(stderr, "verify-kstem: couldn't open %s\n", path);
+      exit(1);
+      }
+   while (fscanf(f, "%ms", &w) == 1)  {
+      add_string(&sets[LEXICON_SET], w);
+      cap = strdup(w);
+      cap[0] = toupper(cap[0]);
+      add_string(&sets[LEXICON_SET], cap);
+      if (!pairs)
+         add_string(&headwords, w);
+      else if (n % 2 == 1 && strlen(w) > longest_root)
+         longest_root = strlen(w);
+      n++;
+      free(cap);
+      free(w);
+      }
+   fclose(f);
+   free(path);
+}
+
+
+static int is_vowel(char c)
+{
+   return strchr("aeiou", c) != NULL;
+}
+
+/* every headword with every ending, spelled the ways the rules expect */
+
+static void make_inflections()
+{
+   WORDS *s = &sets[INFLECTION_SET];
+   char *form, *w;
+   size_t len;
+   unsigned int i, e;
+
+   form = (char *)malloc(64 * 1024);
+   for (i = 0; i < headwords.n; i++)  {
+      w = headwords.text + headwords.offsets[i];
+      len = strlen(w);
+      if (len + 32 > 64 * 1024)
+         continue;
+      for (e = 0; endings[e] != NULL; e++)  {
+         /* as is: `walk' -> `walked' */
+         sprintf(form, "%s%s", w, endings[e]);
+         add_string(s, form);
+         if (len < 2)
+            continue;
+         /* the final consonant doubled: `run' -> `running' */
+         if (!is_vowel(w[len-1]) && is_vowel(w[len-2]))  {
+            sprintf(form, "%s%c%s", w, w[len-1], endings[e]);
+            add_string(s, form);
+            }
+         /* the final e or y replaced: `hope' -> `hoping', `happy' -> `happiness' */
+         if (w[len-1] == 'e' || w[len-1] == 'y')  {
+            sprintf(form, "%.*s%s%s", (int)(len - 1), w, w[len-1] == 'y' ? "i" : "", endings[e]);
+            add_string(s, form);
+            }
+         }
+      }
+   free(form);
+}
+
+
+/* splitmix64, so that fuzz token n depends only on the seed and n */
+
+static unsigned long long next_random(unsigned long long *state)
+{
+   unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+
+   z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+   z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+   return z ^ (z >> 31);
+}
+
+static void fuzz_token(unsigned long n, char *t)
+{
+   static const char letters[] = "eeeeeaaaiiioootnsrhldcumfpgwybvkxjqz";
+   static const char others[] = "0123456789-'./_&$@ \t";
+   unsigned long long state = seed * 0x100000001b3ULL ^ n, r;
+   const char *w;
+   int len, i, kind;
+
+   r = next_random(&state);
+   kind = r % 8;
+   t[0] = '\0';
+   if (kind < 3)  {
+      /* letters, usually with an ending */
+      len = 1 + next_random(&state) % 12;
+      for (i = 0; i < len; i++)
+         t[i] = letters[next_random(&state) % (sizeof(letters) - 1)];
+      t[len] = '\0';
+      if (kind > 0)
+         strcat(t, endings[next_random(&state) % (sizeof(endings) / sizeof(endings[0]) - 1)]);
+      }
+   else if (kind < 6)  {
+      /* a headword with a letter changed, added or removed, and maybe an ending */
+      w = headwords.text + headwords.offsets[next_random(&state) % headwords.n];
+      if (strlen(w) > 100)
+         w = "x";
+      strcpy(t, w);
+      len = strlen(t);
+      i = next_random(&state) % len;
+      switch (kind)  {
+         case 3:
+            t[i] = letters[next_random(&state) % (sizeof(letters) - 1)];
+            break;
+         case 4:
+            memmove(t + i + 1, t + i, len - i + 1);
+            t[i] = letters[next_random(&state) % (sizeof(letters) - 1)];
+            break;
+         case 5:
+            if (len > 1)
+               memmove(t + i, t + i + 1, len - i);
+            break;
+         }
+      if (next_random(&state) % 2)
+         strcat(t, endings[next_random(&state) % (sizeof(endings) / sizeof(endings[0]) - 1)]);
+      }
+   else if (kind == 6)  {
+      /* anything at all: digits, punctuation, upper case, bytes above 127 */
+      len = 1 + next_random(&state) % 16;
+      for (i = 0; i < len; i++)  {
+         r = next_random(&state);
+         switch (r % 4)  {
+            case 0:
+               t[i] = others[(r >> 8) % (sizeof(others) - 1)];
+               break;
+            case 1:
+               t[i] = 'A' + (r >> 8) % 26;
+               break;
+            case 2:
+               t[i] = 128 + (r >> 8) % 127;
+               break;
+            default:
+               t[i] = letters[(r >> 8) % (sizeof(letters) - 1)];
+            }
+         }
+      t[len] = '\0';
+      }
+   else  {
+      /* a long word */
+      len = 30 + next_random(&state) % (MAX_FUZZ_LENGTH - 60);
+      for (i = 0; i < len; i++)
+         t[i] = letters[next_random(&state) % (sizeof(letters) - 1)];
+      t[len] = '\0';
+      strcat(t, endings[next_random(&state) % (sizeof(endings) / sizeof(endings[0]) - 1)]);
+      }
+}
+
+
+/* stem term with the reference and with every engine, and report any difference */
+
+static int compare(int set, char *term, char *expected, char *actual)
+{
+   int e, differed = 0;
+
+   ref_stem(term, expected);
+   for (e = 0; engines[e].name != NULL; e++)  {
+      engines[e].run(term, actual);
+      if (strcmp(expected, actual) != 0)  {
+         differed = 1;
+         pthread_mutex_lock(&report_lock);
+         if (reported++ < MAX_REPORTED)
+            printf("DIFFERENT (%s, %s): %s  reference: %s  %s: %s\n", set_names[set], engines[e].name,
+                   term, expected, engines[e].name, actual);
+         pthread_mutex_unlock(&report_lock);
+         }
+      }
+   return differed;
+}
+
+static void *worker(void *arg)
+{
+   WORKER *me = (WORKER *)arg;
+   char *term, *expected, *actual;
+   size_t size;
+   unsigned long n;
+   int s;
+
+   size = 64 * 1024 + MAX_FUZZ_LENGTH + longest_root + 256;
+   term = (char *)malloc(size);
+   expected = (char *)malloc(size);
+   actual = (char *)malloc(size);
+
+   for (s = 0; s < NUM_SETS - 1; s++)
+      for (n = me->id; n < sets[s].n; n += me->nthreads)  {
+         strcpy(term, sets[s].text + sets[s].offsets[n]);
+         me->differed[s] += compare(s, term, expected, actual);
+         me->compared[s]++;
+         }
+   for (n = me->id; n < nfuzz; n += me->nthreads)  {
+      fuzz_token(n, term);
+      me->differed[FUZZ_SET] += compare(FUZZ_SET, term, expected, actual);
+      me->compared[FUZZ_SET]++;
+      }
+
+   free(term);
+   free(expected);
+   free(actual);
+   return NULL;
+}
+
+
+/* The separators: a text with every kind of white space in it is split by
+   kstem_spans(), and by an analyzer fed a byte at a time, and each token
+   is checked against the word it should be and its stem. */
+
+static const char *spaced_text = "cats\fdogs\vbirds \t\r\n mice\f";
+static const char *spaced_words[] = { "cats", "dogs", "birds", "mice" };
+#define SPACED_WORDS 4
+
+typedef struct
+{
+   unsigned int n;             /* tokens seen */
+   unsigned int differed;
+} TOKENS_SEEN;
+
+static void check_token(const KSTEM_SPAN *span, TOKENS_SEEN *seen)
+{
+   char word[16], expected[64];
+   const char *w = seen->n < SPACED_WORDS ? spaced_words[seen->n] : NULL;
+
+   seen->n++;
+   if (w)  {
+      strcpy(word, w);
+      ref_stem(word, expected);
+      }
+   if (!w || span->length != strlen(w) || strncmp(spaced_text + span->start, w, span->length) != 0
+       || strcmp(span->stem, expected) != 0)  {
+      seen->differed++;
+      printf("DIFFERENT (separators): token %u is \"%.*s\", stemmed %s\n", seen->n,
+             (int)span->length, spaced_text + span->start, span->stem);
+      }
+}
+
+static void check_spanned(const KSTEM_SPAN *span, void *arg)
+{
+   check_token(span, (TOKENS_SEEN *)arg);
+}
+
+static unsigned long check_separators()
+{
+   kstem::Analyzer analyzer;
+   TOKENS_SEEN spans = { 0, 0 }, streamed = { 0, 0 };
+   size_t len = strlen(spaced_text), i;
+   auto check = [&](const KSTEM_SPAN &t) { check_token(&t, &streamed); };
+   unsigned long differed;
+
+   kstem_spans(spaced_text, len, check_spanned, &spans);
+   for (i = 0; i < len; i++)
+      analyzer.feed(spaced_text + i, 1, check);
+   analyzer.finish(check);
+   differed = spans.differed + streamed.differed;
+   if (spans.n != SPACED_WORDS || streamed.n != SPACED_WORDS)  {
+      printf("DIFFERENT (separators): %u tokens spanned and %u streamed, not %d\n", spans.n, streamed.n,
+             SPACED_WORDS);
+      differed++;
+      }
+   printf("%-12s %10u words %8lu different\n", "separators", spans.n + streamed.n, differed);
+   return differed;
+}
+
+
+int main(int argc, char *argv[])
+{
+   static const char *files[] = { "head_word_list.txt", "dict_supplement.txt", "e_exception_words.txt",
+      "direct_conflations.txt", "country_nationality.txt", "proper_nouns.txt", NULL };
+   pthread_t threads[MAX_THREADS];
+   WORKER workers[MAX_THREADS];
+   unsigned long compared, differed, total = 0;
+   const char *stemdir;
+   double t;
+   int nthreads, i, s, c;
+
+   nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+   while ((c = getopt(argc, argv, "t:n:s:")) != -1)  {
+      switch (c)  {
+         case 't':
+            nthreads = atoi(optarg);
+            break;
+         case 'n':
+            nfuzz = strtoul(optarg, NULL, 10);
+            break;
+         case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+         default:
+            fprintf(stderr, "usage: verify-kstem [-t threads] [-n fuzz-tokens] [-s seed]\n");
+            exit(1);
+         }
+      }
+   if (nthreads < 1)
+      nthreads = 1;
+   if (nthreads > MAX_THREADS)
+      nthreads = MAX_THREADS;
+
+   stemdir = getenv("STEM_DIR");
+   if (!stemdir)  {
+      fprintf(stderr, "verify-kstem: STEM_DIR must be set to the directory of lexicon files\n");
+      exit(1);
+      }
+
+   t = now_ms();
+   ref_read_dict_info();
+   read_dict_info();
+   for (i = 0; files[i] != NULL; i++)
+      read_words(stemdir, files[i], strstr(files[i], "conflation") || strstr(files[i], "nationality"));
+   make_inflections();
+
+   memset(workers, 0, sizeof(workers));
+   for (i = 0; i < nthreads; i++)  {
+      workers[i].id = i;
+      workers[i].nthreads = nthreads;
+      pthread_create(&threads[i], NULL, worker, &workers[i]);
+      }
+   for (i = 0; i < nthreads; i++)
+      pthread_join(threads[i], NULL);
+
+   for (s = 0; s < NUM_SETS; s++)  {
+      compared = differed = 0;
+      for (i = 0; i < nthreads; i++)  {
+         compared += workers[i].compared[s];
+         differed += workers[i].differed[s];
+         }
+      printf("%-12s %10lu words %8lu different\n", set_names[s], compared, differed);
+      total += differed;
+      }
+   total += check_separators();
+   printf("seed %llu, %d threads, %.0f ms: %s\n", seed, nthreads, now_ms() - t,
+          total ? "the stemmer DIFFERS from the reference" : "identical to the reference");
+   return total ? 1 : 0;
+}